@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "estimate.h"
+
+#define BITS_PER_BYTE 10          // 8N1: a start bit, eight data bits and a stop bit
+
+void StartEstimate(Estimator *estimator, float acceleration, long baud, double send_seconds) {
+    estimator->acceleration = acceleration;
+    estimator->byte_seconds = (double)BITS_PER_BYTE / baud;
+    estimator->send_seconds = send_seconds;
+    estimator->first = estimator->count = 0;
+    estimator->direction_x = estimator->direction_y = 0;
+    estimator->last_speed = 0;
+    estimator->exit_speed = 0;
+    estimator->sent = 0;
+    estimator->finished = 0;
+    estimator->move_seconds = 0;
+    estimator->pause_seconds = 0;
+    estimator->wait_seconds = 0;
+    estimator->line = 0;
+    estimator->trace = NULL;
+}
+
+static PlannedMove *MoveAt(Estimator *estimator, int i) {
+    return &estimator->moves[(estimator->first + i) % PLANNER_MOVES];
+}
+
+// Time to go length mm starting at entry and ending at exit (mm/s), never going faster than speed. The planner has
+// already made sure the exit can be reached from the entry within the length.
+static double MoveSeconds(float length, float entry, float speed, float exit, float acceleration) {
+    if (length <= 0) {
+        return 0;
+    }
+    double accelerate = ((double)speed * speed - (double)entry * entry) / (2 * acceleration);
+    double decelerate = ((double)speed * speed - (double)exit * exit) / (2 * acceleration);
+    if (accelerate + decelerate <= length) {
+        return (speed - entry) / acceleration + (speed - exit) / acceleration +
+               (length - accelerate - decelerate) / speed;
+    }
+    // Too short to reach the cruise speed, it speeds up to a peak and straight back down
+    double peak = sqrt((2.0 * acceleration * length + (double)entry * entry + (double)exit * exit) / 2);
+    return (peak - entry) / acceleration + (peak - exit) / acceleration;
+}
+
+// Runs the oldest move in the planner. The robot only knows about the moves whose lines have arrived by the time it
+// starts it, and plans to be able to stop at the last of those.
+static void RetireMove(Estimator *estimator) {
+    PlannedMove *move = MoveAt(estimator, 0);
+    float acceleration = estimator->acceleration;
+    double start = estimator->finished;
+    float entry = estimator->exit_speed;
+    if (move->arrival > start) {
+        estimator->wait_seconds += move->arrival - start;
+        start = move->arrival;
+        entry = 0; // It ran out of moves and stopped
+    }
+
+    int last = 0;
+    while (last + 1 < estimator->count && MoveAt(estimator, last + 1)->arrival >= 0 &&
+           MoveAt(estimator, last + 1)->arrival <= start) {
+        last++;
+    }
+    // Backwards from a stop at the end of the last known move: how fast each one may start
+    float exit = 0;
+    for (int i = last; i >= 1; i--) {
+        PlannedMove *next = MoveAt(estimator, i);
+        float fastest = sqrtf(exit * exit + 2 * acceleration * next->length);
+        exit = fminf(fminf(next->max_entry, next->speed), fastest);
+    }
+    entry = fminf(entry, move->speed);
+    exit = fminf(exit, sqrtf(entry * entry + 2 * acceleration * move->length));
+
+    double seconds = MoveSeconds(move->length, entry, move->speed, exit, acceleration);
+    estimator->move_seconds += seconds;
+    estimator->pause_seconds += move->pause;
+    estimator->finished = start + seconds + move->pause;
+    estimator->exit_speed = exit;
+    if (estimator->trace) {
+        fprintf(estimator->trace, "%ld,%.4f,%.4f,%.3f,%.2f,%.2f,%.3f\n", move->line, start, seconds, move->length,
+                entry, exit, move->pause);
+    }
+
+    estimator->first = (estimator->first + 1) % PLANNER_MOVES;
+    estimator->count--;
+}
+
+static void AddMove(Estimator *estimator, const PlannedMove *move) {
+    if (estimator->count == PLANNER_MOVES) {
+        RetireMove(estimator);
+    }
+    *MoveAt(estimator, estimator->count) = *move;
+    estimator->count++;
+}
+
+//Adds a move going (dx, dy) mm, length mm long (an arc is longer than the straight line between its ends). It
+//keeps its speed through a corner as much as the path goes straight on: not at all at a right angle or sharper.
+void EstimateMove(Estimator *estimator, float dx, float dy, float length, int feed) {
+    float straight = hypotf(dx, dy);
+    if (length <= 0 || straight <= 0) {
+        return;
+    }
+    PlannedMove move;
+    move.length = length;
+    move.speed = feed / 60.0f;
+    dx /= straight;
+    dy /= straight;
+    float turn = dx * estimator->direction_x + dy * estimator->direction_y; // Cosine of the angle, 0 after a stop
+    move.max_entry = fminf(move.speed, estimator->last_speed) * fmaxf(turn, 0.0f);
+    move.pause = 0;
+    move.arrival = -1;
+    move.line = estimator->line;
+    AddMove(estimator, &move);
+
+    estimator->direction_x = dx;
+    estimator->direction_y = dy;
+    estimator->last_speed = move.speed;
+}
+
+//Adds a stop where the robot waits seconds, after the moves so far and before the next one. It goes in the planner
+//as a move that goes nowhere and may not be entered at any speed, so the robot slows to a halt before it.
+void EstimateStop(Estimator *estimator, double seconds) {
+    PlannedMove move = {0};
+    move.pause = seconds;
+    move.arrival = -1;
+    move.line = estimator->line;
+    AddMove(estimator, &move);
+    estimator->direction_x = estimator->direction_y = 0;
+}
+
+//Sends what was added since the last send. The bytes take their time on the link and then the sender waits before
+//sending anything else.
+void EstimateSend(Estimator *estimator, long bytes) {
+    double arrival = estimator->sent + bytes * estimator->byte_seconds;
+    for (int i = 0; i < estimator->count; i++) {
+        if (MoveAt(estimator, i)->arrival < 0) {
+            MoveAt(estimator, i)->arrival = arrival;
+        }
+    }
+    estimator->sent = arrival + estimator->send_seconds;
+}
+
+//Runs the moves still in the planner and returns the time the whole job takes
+double FinishEstimate(Estimator *estimator) {
+    while (estimator->count > 0) {
+        RetireMove(estimator);
+    }
+    return estimator->finished;
+}
+
+//Writes a line for every move as the robot runs it: the G-code line it came from, when it starts and how long it
+//takes (s), its length (mm), the speeds it starts and ends at (mm/s) and how long the robot then stands still (s).
+void TraceEstimate(Estimator *estimator, FILE *file) {
+    estimator->trace = file;
+    fprintf(file, "line,start,seconds,length,entry_speed,exit_speed,pause\n");
+}
@@ -0,0 +1,45 @@
+#ifndef ESTIMATE_H_INCLUDED
+#define ESTIMATE_H_INCLUDED
+
+#include <stdio.h>
+
+#define PLANNER_MOVES 16          // Moves the robot looks ahead over, like GRBL's planner buffer
+
+//A move waiting in the planner
+typedef struct {
+    float length;                 // mm, 0 for a stop
+    float speed;                  // Cruise speed (mm/s)
+    float max_entry;              // Fastest it may start (mm/s), from how sharply the path turns into it
+    double pause;                 // Seconds the robot stands still after it (pen change and dwell)
+    double arrival;               // When its line has reached the robot, -1 until it is sent
+    long line;                    // G-code line it came from, for the trace
+} PlannedMove;
+
+//Works out how long the robot takes over the G-code as it is sent: moves speed up and slow down at a fixed
+//acceleration, and the robot can only start a move once its line has come over the serial link.
+typedef struct {
+    float acceleration;           // mm/s^2
+    double byte_seconds;          // Time to send one byte
+    double send_seconds;          // Wait after each send
+    PlannedMove moves[PLANNER_MOVES];
+    int first, count;             // The moves in the planner, a ring from first
+    float direction_x, direction_y; // Unit direction of the last move added, 0 after a stop
+    float last_speed;             // Cruise speed of the last move added
+    float exit_speed;             // Speed the last retired move finished at
+    double sent;                  // When the sender is ready to send the next line
+    double finished;              // When the robot finishes the moves retired so far
+    double move_seconds;          // Time spent moving
+    double pause_seconds;         // Time spent stood still for pen changes
+    double wait_seconds;          // Time the robot stood waiting for the next line
+    long line;                    // G-code line of the moves added next, for the trace
+    FILE *trace;                  // Each move's timing is written here as it is run, NULL for none
+} Estimator;
+
+void StartEstimate(Estimator *estimator, float acceleration, long baud, double send_seconds);
+void EstimateMove(Estimator *estimator, float dx, float dy, float length, int feed); // A move of length mm at feed mm/min
+void EstimateStop(Estimator *estimator, double seconds);   // The robot stops and waits, for a pen change
+void EstimateSend(Estimator *estimator, long bytes);       // The lines of the moves added so far are sent
+double FinishEstimate(Estimator *estimator);               // Seconds from the first line sent to the robot stopping
+void TraceEstimate(Estimator *estimator, FILE *file);      // Write out the timing of every move
+
+#endif // ESTIMATE_H_INCLUDED
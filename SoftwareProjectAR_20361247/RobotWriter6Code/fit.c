@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "fit.h"
+#include "layout.h"
+
+static int AddWord(MeasuredText *text, int width) {
+    if (text->count == text->size) {
+        long size = text->size ? 2 * text->size : 1024;
+        MeasuredWord *words = realloc(text->words, size * sizeof(MeasuredWord));
+        if (!words) {
+            perror("Error allocating words");
+            return -1;
+        }
+        text->words = words;
+        text->size = size;
+    }
+    text->words[text->count].width = width;
+    text->words[text->count].newlines = -1;
+    text->count++;
+    return 0;
+}
+
+// Adds a character's advance to the running width of the word, and its points to how high and low the text goes
+static int AddCharacter(MeasuredText *text, const Font *font, char c, int *width) {
+    const FontData *glyph = GetGlyph(font, (int)c);
+    if (!glyph) {
+        fprintf(stderr, "Error: Invalid or undefined character '%c' (ASCII: %d) encountered.\n", c, (int)c);
+        return -1;
+    }
+    *width += glyph->advance;
+    for (int i = 0; i < glyph->num_points; i++) {
+        text->top = glyph->point_y[i] > text->top ? (int)glyph->point_y[i] : text->top;
+        text->bottom = glyph->point_y[i] < text->bottom ? (int)glyph->point_y[i] : text->bottom;
+    }
+    return 0;
+}
+
+//Reads the text into the words StreamText() would hand the layout, each with its width in font units: the sum of
+//its characters' advances, so a word's width is the difference of two running totals. A word over
+//MAX_WORD_LENGTH is split the same way. Returns -1 if a character is not in the font.
+int MeasureText(FILE *file, const Font *font, MeasuredText *text) {
+    char chunk[TEXT_CHUNK_SIZE];
+    int length = 0, width = 0, in_gap = 0, newlines = 0;
+    size_t count;
+    text->words = NULL;
+    text->count = text->size = 0;
+    text->top = text->bottom = 0;
+
+    int result = 0;
+    while (result == 0 && (count = fread(chunk, sizeof(char), sizeof(chunk), file)) > 0) {
+        for (size_t i = 0; i < count && result == 0; i++) {
+            char c = chunk[i];
+            if (c == ' ' || c == '\n') {
+                in_gap = 1;
+                newlines += c == '\n';
+                continue;
+            }
+            if (in_gap) {
+                result = AddWord(text, width);
+                if (result == 0) {
+                    text->words[text->count - 1].newlines = newlines;
+                }
+                length = width = 0;
+                in_gap = 0;
+                newlines = 0;
+            }
+            if (result == 0 && length == MAX_WORD_LENGTH) {
+                result = AddWord(text, width);
+                length = width = 0;
+            }
+            if (result == 0) {
+                result = AddCharacter(text, font, c, &width);
+                length++;
+            }
+        }
+    }
+    if (result == 0 && (length > 0 || in_gap)) {
+        result = AddWord(text, width);
+        if (result == 0 && in_gap) {
+            text->words[text->count - 1].newlines = newlines;
+        }
+    }
+    rewind(file);
+    if (result != 0) {
+        FreeMeasuredText(text);
+    }
+    return result;
+}
+
+void FreeMeasuredText(MeasuredText *text) {
+    free(text->words);
+    text->words = NULL;
+    text->count = text->size = 0;
+}
+
+//Room (mm) each line keeps free for a slant, the layout's slant_room: the tops of the characters lean right of where
+//they start and the bottoms left, by the slant times how far they reach from the baseline
+float SlantRoom(const MeasuredText *text, float slant, float height) {
+    return (text->top - text->bottom) * fabsf(slant) * height / FONT_UNITS_HIGH;
+}
+
+// Follows LayoutWord() and LayoutGap() through the words with lines limit font units wide, and returns how many
+// lines it takes to reach the last ink. Returns -1 if a word is wider than a line on its own.
+static long CountLines(const MeasuredText *text, double limit) {
+    long line = 0, lines = 0;
+    long x = 0;
+    for (long i = 0; i < text->count; i++) {
+        const MeasuredWord *word = &text->words[i];
+        if (x + word->width > limit) {
+            line++;
+            x = 0;
+        }
+        if (word->width > 0) {
+            if (word->width > limit) {
+                return -1;
+            }
+            lines = line + 1;
+        }
+        x += word->width;
+        if (word->newlines >= 0) {
+            line += word->newlines;
+            x = word->newlines > 0 ? 0 : x;
+            x += WORD_SPACING;
+        }
+    }
+    return lines;
+}
+
+// Whether the text fits width x height mm at a text height. Lines are a text height apart, and the first and last
+// are allowed the most any character in the text reaches up and down. Lines wrap where LayoutWord() wraps them, the
+// width less the slant room.
+static int Fits(const MeasuredText *text, float width, float height, float slant, float text_height) {
+    double scale = text_height / FONT_UNITS_HIGH;
+    // A little slack so a word exactly the width of a line is not pushed over by rounding
+    long lines = CountLines(text, (width - SlantRoom(text, slant, text_height)) / scale + 1e-3);
+    if (lines < 0) {
+        return 0;
+    }
+    if (lines == 0) {
+        return 1;
+    }
+    return ((lines - 1) * FONT_UNITS_HIGH + text->top - text->bottom) * scale <= height;
+}
+
+//Finds the largest text height, to a hundredth of a mm, between min_height and max_height at which the text fits
+//in a box width x height mm with lines wrapped at the width. More height only ever takes more lines and more room,
+//so a binary search finds it, and each height tried is one walk through the words. Returns 0 if it does not fit
+//even at min_height.
+float FitHeight(const MeasuredText *text, float width, float height, float slant, float min_height, float max_height) {
+    long low = lroundf(min_height * 100), high = lroundf(max_height * 100);
+    if (!Fits(text, width, height, slant, low / 100.0f)) {
+        return 0;
+    }
+    while (low < high) {
+        long middle = (low + high + 1) / 2; // Fits at low, so look above it
+        if (Fits(text, width, height, slant, middle / 100.0f)) {
+            low = middle;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+    return low / 100.0f;
+}
@@ -0,0 +1,26 @@
+#ifndef FIT_H_INCLUDED
+#define FIT_H_INCLUDED
+
+#include <stdio.h>
+#include "font.h"
+
+//A word as the layout gets it, measured in font units so the text can be laid out again at any height
+typedef struct {
+    int width;                    // Sum of the characters' advances
+    int newlines;                 // Newlines in the gap after it, -1 if a long word carries straight on
+} MeasuredWord;
+
+//The whole text measured once, so each height tried only walks the words
+typedef struct {
+    MeasuredWord *words;
+    long count, size;
+    int top, bottom;              // Highest and lowest y (font units) of any character in the text
+} MeasuredText;
+
+int MeasureText(FILE *file, const Font *font, MeasuredText *text); // Read the words' widths, then rewind; -1 if undrawable
+float FitHeight(const MeasuredText *text, float width, float height, float slant, float min_height,
+                float max_height);                      // Largest text height that fits width x height mm, 0 if none
+float SlantRoom(const MeasuredText *text, float slant, float height); // Room (mm) a line leaves for the slant
+void FreeMeasuredText(MeasuredText *text);
+
+#endif // FIT_H_INCLUDED
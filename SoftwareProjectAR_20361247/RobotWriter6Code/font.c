@@ -0,0 +1,569 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <math.h>
+
+#include "font.h"
+#include "glyph.h"
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+#define FONT_WATCH_MS 500   // How often the font watcher checks for changes (or for being asked to stop)
+
+// One registered font. The snapshot in current is replaced, never changed, when the font file is reloaded.
+typedef struct {
+    char name[FONT_NAME_SIZE];
+    char filename[FONT_FILE_SIZE];
+    int options;
+    Font *current;
+} FontSlot;
+
+// The registry of loaded fonts. The mutex guards the slots (and swapping snapshots), jobs only ever read the fonts themselves.
+static FontSlot slots[MAX_FONTS];
+static int font_count = 0;
+static pthread_mutex_t font_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The background thread that reloads fonts when their files change
+static pthread_t watcher;
+static int watcher_running = 0;
+static atomic_int watcher_stop;
+
+// Copies the line starting at *offset in the snapshot's copy of the file into line, like fgets() would, and moves
+// *offset on to the next line. Returns 0 at the end of the file.
+static int ReadLine(const Font *font, long *offset, char *line, size_t size) {
+    if (*offset < 0 || *offset >= font->data_size) {
+        return 0;
+    }
+    const char *start = font->data + *offset;
+    const char *end = memchr(start, '\n', font->data_size - *offset);
+    size_t length = end ? (size_t)(end - start) + 1 : (size_t)(font->data_size - *offset);
+    *offset += (long)length;
+    length = length < size ? length : size - 1;
+    memcpy(line, start, length);
+    line[length] = '\0';
+    return 1;
+}
+
+// Reads the cached index written by WriteFontIndex(). It is only used if the font file still has the size and
+// modification time it had when the index was written and every offset in it finds its character, otherwise the
+// index is rebuilt.
+static int ReadFontIndex(Font *font, const struct stat *info) {
+    char index_file[FONT_FILE_SIZE + sizeof(FONT_INDEX_SUFFIX)];
+    snprintf(index_file, sizeof(index_file), "%s%s", font->filename, FONT_INDEX_SUFFIX);
+    FILE *file = fopen(index_file, "r");
+    if (!file) {
+        return -1;
+    }
+
+    long long size, mtime;
+    int count = 0, expected;
+    char line[100];
+    int ok = fscanf(file, "FONTINDEX %lld %lld %d", &size, &mtime, &expected) == 3 &&
+             size == (long long)info->st_size && mtime == (long long)info->st_mtime;
+    int ascii;
+    long offset;
+    while (ok && fscanf(file, "%d %ld", &ascii, &offset) == 2) {
+        if (ascii < 0 || ascii >= MAX_FONT_DATA || offset < 0) {
+            ok = 0;
+            break;
+        }
+        font->offsets[ascii] = offset;
+        count++;
+    }
+    fclose(file);
+
+    // Every offset has to land on its character's '999' line in the bytes this snapshot holds
+    for (int i = 0; ok && i < MAX_FONT_DATA; i++) {
+        long at = font->offsets[i];
+        ok = at < 0 || (ReadLine(font, &at, line, sizeof(line)) && sscanf(line, "999 %d", &ascii) == 1 &&
+                        ascii == i);
+    }
+
+    // A half written or stale index is thrown away
+    if (!ok || count != expected) {
+        for (int i = 0; i < MAX_FONT_DATA; i++) {
+            font->offsets[i] = -1;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Saves the index next to the font file so the next run can skip the scan. Failing to save it is not an error.
+static void WriteFontIndex(const Font *font, const struct stat *info, int count) {
+    char index_file[FONT_FILE_SIZE + sizeof(FONT_INDEX_SUFFIX)];
+    char temp_file[FONT_FILE_SIZE + sizeof(FONT_INDEX_SUFFIX) + 4];
+    snprintf(index_file, sizeof(index_file), "%s%s", font->filename, FONT_INDEX_SUFFIX);
+    snprintf(temp_file, sizeof(temp_file), "%s.tmp", index_file);
+
+    FILE *file = fopen(temp_file, "w");
+    if (!file) {
+        return;
+    }
+    fprintf(file, "FONTINDEX %lld %lld %d\n", (long long)info->st_size, (long long)info->st_mtime, count);
+    for (int i = 0; i < MAX_FONT_DATA; i++) {
+        if (font->offsets[i] >= 0) {
+            fprintf(file, "%d %ld\n", i, font->offsets[i]);
+        }
+    }
+    if (fclose(file) != 0) {
+        remove(temp_file);
+        return;
+    }
+    remove(index_file); // rename() does not replace an existing file on Windows
+    rename(temp_file, index_file);
+}
+
+// The index pass: one read through the file that only looks at the '999' lines and records where each one starts
+static int ScanFontIndex(Font *font) {
+    char line[100];
+    int count = 0;
+
+    for (int i = 0; i < MAX_FONT_DATA; i++) {
+        font->offsets[i] = -1;
+    }
+    long offset = 0, next = 0;
+    while (ReadLine(font, &next, line, sizeof(line))) {
+        int ascii;
+        if (strncmp(line, "999", 3) == 0 && sscanf(line, "999 %d", &ascii) == 1 &&
+            ascii >= 0 && ascii < MAX_FONT_DATA) {
+            if (font->offsets[ascii] < 0) {
+                count++;
+            }
+            font->offsets[ascii] = offset;
+        }
+        offset = next;
+    }
+    return count;
+}
+
+//The function to read the font data file into the snapshot and build (or read back) the index of where each
+//character starts
+int LoadFontIndex(const char *filename, Font *font) {
+    struct stat info;
+
+    // Open the font data file for reading. Binary mode so the offsets are plain byte counts on Windows too.
+    FILE *file = stat(filename, &info) == 0 ? fopen(filename, "rb") : NULL;
+    if (!file) {
+        perror("Error opening font file"); // Display an error if the file cannot be opened
+        return -1;
+    }
+
+    // The snapshot keeps its own copy, so a later edit to the file only reaches the snapshot a reload makes
+    font->data_size = (long)info.st_size;
+    font->data = malloc(font->data_size > 0 ? font->data_size : 1);
+    if (!font->data || fread(font->data, 1, font->data_size, file) != (size_t)font->data_size) {
+        perror("Error reading font file");
+        free(font->data);
+        font->data = NULL;
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    for (int i = 0; i < MAX_FONT_DATA; i++) {
+        atomic_init(&font->loaded[i], 0);
+        atomic_init(&font->simplified[i], NULL);
+    }
+    pthread_mutex_init(&font->lock, NULL);
+
+    font->file_size = (long long)info.st_size;
+    font->file_mtime = (long long)info.st_mtime;
+    if (ReadFontIndex(font, &info) != 0) {
+        int count = ScanFontIndex(font);
+        WriteFontIndex(font, &info, count);
+    }
+    return 0;
+}
+
+// Parses one character's movements from its '999' block. Returns -1 if the block is not where the index says.
+static int ParseGlyph(Font *font, int ascii) {
+    char line[100]; // This is to store lines read from the file
+    FontData *glyph = &font->glyphs[ascii];
+    int header_ascii, num_movements; // Variables to store ASCII value and movement count
+    long offset = font->offsets[ascii];
+
+    if (!ReadLine(font, &offset, line, sizeof(line)) ||
+        sscanf(line, "999 %d %d", &header_ascii, &num_movements) != 2 || header_ascii != ascii) {
+        return -1;
+    }
+    if (num_movements < 0 || num_movements > MAX_MOVEMENTS) {
+        fprintf(stderr, "Error: Bad character header in font file '%s': %s", font->filename, line);
+        num_movements = 0;
+    }
+    glyph->ascii = ascii; // Store the ASCII value
+    glyph->num_movements = num_movements; // Store the number of movements
+
+    // Using a for loop to read each movement for the character
+    for (int i = 0; i < num_movements; i++) {
+        if (!ReadLine(font, &offset, line, sizeof(line)) ||
+            sscanf(line, "%d %d %d", &glyph->movements[i].x, // Parse x-coordinate
+                                     &glyph->movements[i].y, // Parse y-coordinate
+                                     &glyph->movements[i].pen) != 3) { // Parse pen state
+            fprintf(stderr, "Error: Character %d in font file '%s' is cut short.\n", ascii, font->filename);
+            glyph->num_movements = i;
+            break;
+        }
+    }
+    glyph->advance = glyph->num_movements > 0 ? glyph->movements[glyph->num_movements - 1].x : 0;
+
+    // The optimised movements are what gets stored, so no job pays for the optimisation again
+    if ((font->options & FONT_OPTIMISE_STROKES) && glyph->num_movements > 0) {
+        OptimiseGlyph(glyph);
+    }
+    PrepareGlyphPoints(glyph);
+    return 0;
+}
+
+// Returns the movements for a character, parsing them from the snapshot's copy of the font file the first time
+// they are asked for.
+// Returns NULL for a character the font does not draw. The glyph table only ever fills in, so a font handed
+// out as const is still safe to share between threads.
+const FontData *GetGlyph(const Font *shared_font, int ascii) {
+    if (ascii < 0 || ascii >= MAX_FONT_DATA) {
+        return NULL;
+    }
+    Font *font = (Font *)shared_font;
+    const FontData *glyph = &font->glyphs[ascii];
+    if (atomic_load_explicit(&font->loaded[ascii], memory_order_acquire)) {
+        return glyph->num_movements > 0 ? glyph : NULL;
+    }
+
+    pthread_mutex_lock(&font->lock);
+    if (!atomic_load_explicit(&font->loaded[ascii], memory_order_relaxed)) {
+        int found = font->offsets[ascii] >= 0 && ParseGlyph(font, ascii) == 0;
+        if (!found && font->offsets[ascii] >= 0) {
+            // The index was checked against this snapshot's bytes, so this is a bug rather than an edited file
+            fprintf(stderr, "Error: Character %d is not where the index of font '%s' says.\n", ascii, font->name);
+        }
+        if (!found) {
+            font->glyphs[ascii].ascii = ascii;
+            font->glyphs[ascii].num_movements = 0;
+        }
+        atomic_store_explicit(&font->loaded[ascii], 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&font->lock);
+    return glyph->num_movements > 0 ? glyph : NULL;
+}
+
+// Returns the character simplified so that at the given text height no point is more than tolerance mm from
+// where the font put it. The result is cached per (character, height, tolerance), so only the first job at a
+// height pays for it. A tolerance of 0 returns the character as loaded.
+const FontData *GetSimplifiedGlyph(const Font *shared_font, int ascii, float height, float tolerance) {
+    const FontData *glyph = GetGlyph(shared_font, ascii);
+    if (!glyph || tolerance <= 0) {
+        return glyph;
+    }
+    Font *font = (Font *)shared_font;
+    int height_key = (int)lroundf(height * 100);
+    int tolerance_key = (int)lroundf(tolerance * 1000);
+
+    SimplifiedGlyph *cached = atomic_load_explicit(&font->simplified[ascii], memory_order_acquire);
+    for (; cached; cached = cached->next) {
+        if (cached->height_key == height_key && cached->tolerance_key == tolerance_key) {
+            return &cached->glyph;
+        }
+    }
+
+    // Work out the simplified copy outside the lock, then check again in case another thread beat us to it
+    SimplifiedGlyph *entry = malloc(sizeof(SimplifiedGlyph));
+    if (!entry) {
+        return glyph;
+    }
+    entry->height_key = height_key;
+    entry->tolerance_key = tolerance_key;
+    entry->glyph = *glyph;
+    SimplifyGlyph(&entry->glyph, tolerance * FONT_UNITS_HIGH / height); // mm to font units
+    PrepareGlyphPoints(&entry->glyph);
+
+    pthread_mutex_lock(&font->lock);
+    for (cached = atomic_load_explicit(&font->simplified[ascii], memory_order_relaxed); cached; cached = cached->next) {
+        if (cached->height_key == height_key && cached->tolerance_key == tolerance_key) {
+            break;
+        }
+    }
+    if (cached) {
+        free(entry);
+        entry = cached;
+    }
+    else {
+        entry->next = atomic_load_explicit(&font->simplified[ascii], memory_order_relaxed);
+        atomic_store_explicit(&font->simplified[ascii], entry, memory_order_release);
+    }
+    pthread_mutex_unlock(&font->lock);
+    return &entry->glyph;
+}
+
+// Frees the copy of the font file and the glyph tables
+static void FreeFont(Font *font) {
+    for (int i = 0; i < MAX_FONT_DATA; i++) {
+        SimplifiedGlyph *entry = atomic_load(&font->simplified[i]);
+        while (entry) {
+            SimplifiedGlyph *next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(font->data);
+    pthread_mutex_destroy(&font->lock);
+    free(font);
+}
+
+// Hands a snapshot back. The last holder frees it, which is how an old snapshot goes away after a reload.
+void ReleaseFont(const Font *shared_font) {
+    Font *font = (Font *)shared_font;
+    if (font && atomic_fetch_sub(&font->refs, 1) == 1) {
+        FreeFont(font);
+    }
+}
+
+// Reads and indexes a font file into a new snapshot that only the registry holds so far
+static Font *LoadSnapshot(const FontSlot *slot) {
+    Font *font = calloc(1, sizeof(Font));
+    if (!font) {
+        perror("Error allocating font");
+        return NULL;
+    }
+    strcpy(font->name, slot->name);
+    strcpy(font->filename, slot->filename);
+    font->options = slot->options;
+    atomic_init(&font->refs, 1);
+    if (LoadFontIndex(slot->filename, font) != 0) {
+        free(font);
+        return NULL;
+    }
+    return font;
+}
+
+static FontSlot *FindSlot(const char *name) {
+    for (int i = 0; i < font_count; i++) {
+        if (strcmp(slots[i].name, name) == 0) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Loads a font under the given name. A name that is already registered is not parsed again.
+int RegisterFont(const char *name, const char *filename, int options) {
+    FontSlot slot = {0};
+    if (strlen(name) >= FONT_NAME_SIZE || strlen(filename) >= FONT_FILE_SIZE) {
+        fprintf(stderr, "Error: Font name or file name too long: %s\n", name);
+        return -1;
+    }
+    strcpy(slot.name, name);
+    strcpy(slot.filename, filename);
+    slot.options = options;
+
+    pthread_mutex_lock(&font_lock);
+    int registered = FindSlot(name) != NULL;
+    pthread_mutex_unlock(&font_lock);
+    if (registered) {
+        return 0;
+    }
+
+    // Parse outside the lock so other threads can keep using fonts meanwhile
+    slot.current = LoadSnapshot(&slot);
+    if (!slot.current) {
+        return -1;
+    }
+
+    int result = 0;
+    pthread_mutex_lock(&font_lock);
+    if (FindSlot(name)) {
+        ReleaseFont(slot.current); // Another thread registered it while we were parsing
+    }
+    else if (font_count == MAX_FONTS) {
+        fprintf(stderr, "Error: Cannot register font '%s', the registry holds at most %d fonts.\n", name, MAX_FONTS);
+        ReleaseFont(slot.current);
+        result = -1;
+    }
+    else {
+        slots[font_count++] = slot;
+    }
+    pthread_mutex_unlock(&font_lock);
+    return result;
+}
+
+// Returns the current snapshot of the named font, or NULL if there is none. The snapshot stays valid, and
+// unchanged, until it is handed back with ReleaseFont() even if the font is reloaded in the meantime.
+const Font *AcquireFont(const char *name) {
+    Font *font = NULL;
+    pthread_mutex_lock(&font_lock);
+    FontSlot *slot = FindSlot(name);
+    if (slot) {
+        font = slot->current;
+        atomic_fetch_add(&font->refs, 1);
+    }
+    pthread_mutex_unlock(&font_lock);
+    return font;
+}
+
+// Re-reads a font file into a new snapshot and swaps it in. Jobs already holding the old snapshot keep it,
+// new jobs get the new one. If the file does not load the old snapshot stays in use.
+int ReloadFont(const char *name) {
+    FontSlot copy;
+    pthread_mutex_lock(&font_lock);
+    FontSlot *slot = FindSlot(name);
+    if (slot) {
+        copy = *slot;
+    }
+    pthread_mutex_unlock(&font_lock);
+    if (!slot) {
+        return -1;
+    }
+
+    Font *font = LoadSnapshot(&copy);
+    if (!font) {
+        fprintf(stderr, "Font '%s' not reloaded, still using the previous version.\n", name);
+        return -1;
+    }
+
+    pthread_mutex_lock(&font_lock);
+    Font *old = slot->current;
+    slot->current = font;
+    pthread_mutex_unlock(&font_lock);
+    ReleaseFont(old); // Freed now, or by the last job still using it
+    printf("Font '%s' reloaded from %s.\n", name, copy.filename);
+    return 0;
+}
+
+int FontCount(void) {
+    pthread_mutex_lock(&font_lock);
+    int count = font_count;
+    pthread_mutex_unlock(&font_lock);
+    return count;
+}
+
+// Registered font names by position (for listing). Names never change once registered.
+const char *FontNameAt(int index) {
+    const char *name = NULL;
+    pthread_mutex_lock(&font_lock);
+    if (index >= 0 && index < font_count) {
+        name = slots[index].name;
+    }
+    pthread_mutex_unlock(&font_lock);
+    return name;
+}
+
+// Drops the registry's hold on every font. Only call this once the font watcher has been stopped.
+void UnloadFonts(void) {
+    pthread_mutex_lock(&font_lock);
+    for (int i = 0; i < font_count; i++) {
+        ReleaseFont(slots[i].current);
+        slots[i].current = NULL;
+    }
+    font_count = 0;
+    pthread_mutex_unlock(&font_lock);
+}
+
+#if defined(__linux__)
+
+// Watches the folders holding the font files with inotify. Editors often save by writing a new file and renaming
+// it over the old one, so both a finished write and a rename onto the font's name trigger a reload.
+static void *WatchFonts(void *unused) {
+    (void)unused;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int fd = inotify_init1(IN_NONBLOCK);
+    if (fd < 0) {
+        perror("Error starting font watcher");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&font_lock);
+    for (int i = 0; i < font_count; i++) {
+        char folder[FONT_FILE_SIZE];
+        strcpy(folder, slots[i].filename);
+        char *slash = strrchr(folder, '/');
+        if (slash) {
+            *slash = '\0';
+        }
+        inotify_add_watch(fd, slash ? folder : ".", IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+    pthread_mutex_unlock(&font_lock);
+
+    while (!atomic_load(&watcher_stop)) {
+        struct pollfd poll_fd = {fd, POLLIN, 0};
+        if (poll(&poll_fd, 1, FONT_WATCH_MS) <= 0) {
+            continue; // Timed out, go round to check whether we should stop
+        }
+
+        ssize_t length = read(fd, events, sizeof(events));
+        for (char *p = events; length > 0 && p < events + length; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+
+            // Reload every font whose file has this name (a name in another watched folder only costs a spare reload)
+            for (int i = 0; i < FontCount(); i++) {
+                const char *name = FontNameAt(i);
+                char filename[FONT_FILE_SIZE];
+                pthread_mutex_lock(&font_lock);
+                strcpy(filename, slots[i].filename);
+                pthread_mutex_unlock(&font_lock);
+                const char *base = strrchr(filename, '/');
+                if (strcmp(base ? base + 1 : filename, event->name) == 0) {
+                    ReloadFont(name);
+                }
+            }
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+#else
+
+// Without inotify the watcher checks the size and modification time of each font file instead
+static void *WatchFonts(void *unused) {
+    (void)unused;
+    while (!atomic_load(&watcher_stop)) {
+        Sleep(FONT_WATCH_MS);
+        for (int i = 0; i < FontCount(); i++) {
+            const char *name = FontNameAt(i);
+            const Font *font = AcquireFont(name);
+            struct stat info;
+            int changed = stat(font->filename, &info) == 0 &&
+                          ((long long)info.st_size != font->file_size || (long long)info.st_mtime != font->file_mtime);
+            ReleaseFont(font);
+            if (changed) {
+                ReloadFont(name);
+            }
+        }
+    }
+    return NULL;
+}
+
+#endif
+
+// Starts the background thread that reloads a font whenever its file changes
+int StartFontWatcher(void) {
+    if (watcher_running) {
+        return 0;
+    }
+    atomic_store(&watcher_stop, 0);
+    if (pthread_create(&watcher, NULL, WatchFonts, NULL) != 0) {
+        fprintf(stderr, "Error: Could not start the font watcher.\n");
+        return -1;
+    }
+    watcher_running = 1;
+    return 0;
+}
+
+void StopFontWatcher(void) {
+    if (watcher_running) {
+        atomic_store(&watcher_stop, 1);
+        pthread_join(watcher, NULL);
+        watcher_running = 0;
+    }
+}
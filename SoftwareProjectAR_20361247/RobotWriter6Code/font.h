@@ -0,0 +1,86 @@
+#ifndef FONT_H_INCLUDED
+#define FONT_H_INCLUDED
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+//Defining the limits for the movements, the font data and the font registry
+#define MAX_FONT_DATA 128
+#define MAX_MOVEMENTS 100
+#define MAX_GLYPH_POINTS (2 * MAX_MOVEMENTS) // Each stroke has the point it starts from as well as its movements
+#define MAX_FONTS 8
+#define FONT_NAME_SIZE 32
+#define FONT_FILE_SIZE 260
+#define FONT_UNITS_HIGH 18.0f           // Height of the characters in font units, used to scale to the text height
+
+#define DEFAULT_FONT_NAME "default"
+#define DEFAULT_FONT_FILE "SingleStrokeFont.txt"
+#define FONT_INDEX_SUFFIX ".idx"       // The byte-offset index is cached next to the font file
+
+//Created a structure just to store the data of when the robot should lift the pen and where to move next
+typedef struct {
+    int x;
+    int y;
+    int pen;
+} Movement;
+
+//Created a structure to store the font data details and this also includes the Movement structure
+typedef struct {
+    int ascii;
+    int num_movements;
+    int advance;                        // Where the next character starts: the x of the last movement
+    Movement movements[MAX_MOVEMENTS];
+
+    // The same pen-down runs as strokes, x and y in arrays of their own so the layout can move all of a
+    // character's points into place in one batch (TransformPoints). Filled in by PrepareGlyphPoints().
+    int num_points, num_strokes;
+    float point_x[MAX_GLYPH_POINTS], point_y[MAX_GLYPH_POINTS]; // Font units
+    int stroke_first[MAX_MOVEMENTS], stroke_count[MAX_MOVEMENTS];
+} FontData;
+
+//Options a font is registered with
+#define FONT_OPTIMISE_STROKES 1         // Run OptimiseGlyph() on each character as it is loaded
+
+//A copy of a character simplified for one text height, kept so the next job at that height can reuse it
+typedef struct SimplifiedGlyph {
+    int height_key;                     // Text height in hundredths of a mm
+    int tolerance_key;                  // Tolerance in thousandths of a mm
+    FontData glyph;
+    struct SimplifiedGlyph *next;
+} SimplifiedGlyph;
+
+//A snapshot of a registered font: its own glyph tables plus the name jobs use to pick it.
+//The file is read into the snapshot and indexed when the font is loaded, a character's movements are parsed from
+//that copy the first time a job asks for it with GetGlyph(), so editing the file never changes a snapshot.
+//Jobs only ever read a font, so any number of jobs or threads can share it. Reloading the file makes a new
+//snapshot; a job keeps the one it acquired until it releases it.
+typedef struct {
+    char name[FONT_NAME_SIZE];
+    char filename[FONT_FILE_SIZE];
+    int options;                        // FONT_OPTIMISE_STROKES etc.
+    atomic_int refs;                    // The registry's hold plus one per job using this snapshot
+    long long file_size, file_mtime;    // The font file this snapshot was loaded from
+    char *data;                         // The font file's bytes as they were when this snapshot was loaded
+    long data_size;
+    long offsets[MAX_FONT_DATA];        // Byte offset of each character's 999 line, -1 if the font has none
+    atomic_int loaded[MAX_FONT_DATA];   // Set once the matching entry in glyphs has been parsed
+    pthread_mutex_t lock;               // Only one thread parses characters at a time
+    FontData glyphs[MAX_FONT_DATA];
+    SimplifiedGlyph *_Atomic simplified[MAX_FONT_DATA]; // Per character list of simplified copies, newest first
+} Font;
+
+int LoadFontIndex(const char *filename, Font *font);          // Open a font file and find where each character starts
+const FontData *GetGlyph(const Font *font, int ascii);        // A character's movements, parsed on first use (NULL if undefined)
+const FontData *GetSimplifiedGlyph(const Font *font, int ascii, float height, float tolerance); // Same, simplified for a height
+int RegisterFont(const char *name, const char *filename, int options); // Load a font once and add it to the registry
+const Font *AcquireFont(const char *name);                    // Current snapshot of a registered font (NULL if unknown)
+void ReleaseFont(const Font *font);                           // Hand a snapshot back once the job is done with it
+int ReloadFont(const char *name);                             // Re-read a font file and swap the new snapshot in
+int FontCount(void);                                          // Number of fonts in the registry
+const char *FontNameAt(int index);                            // Registered font name by position (for listing)
+void UnloadFonts(void);                                       // Free every registered font
+int StartFontWatcher(void);                                   // Reload fonts in the background when their files change
+void StopFontWatcher(void);
+
+#endif // FONT_H_INCLUDED
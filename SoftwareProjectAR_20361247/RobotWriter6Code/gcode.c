@@ -0,0 +1,598 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "gcode.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define RELATIVE_RESYNC 32        // Most relative moves in a row before an absolute position is sent again
+#define ARC_MIN_MOVES 3           // Fewer moves than this are not worth an arc
+#define ARC_MAX_RADIUS 100.0      // Flatter runs are left to the G1 merging, the centre gets too far away
+#define ARC_MAX_STEP (M_PI / 2)   // Largest turn (radians) about the centre one move may make
+#define ARC_MAX_SWEEP (1.9 * M_PI) // Short of a full circle, where the start and end would be the same point
+
+static void Send(GCodeEmitter *emitter) {
+    emitter->send(emitter->buffer);
+    const char *p = emitter->buffer;
+    for (; *p; p++) {
+        emitter->lines += *p == '\n';
+    }
+    emitter->bytes += p - emitter->buffer;
+    if (emitter->estimator) {
+        EstimateSend(emitter->estimator, p - emitter->buffer);
+    }
+    if (emitter->record) {
+        fwrite(emitter->buffer, 1, p - emitter->buffer + 1, emitter->record);
+    }
+}
+
+// A coordinate in mm as a whole number of hundredths. A float times 100 is exact in a double and nearbyint() rounds
+// halves to even like printf does, so this is the number "%.2f" would print on every platform.
+static long long ToHundredths(float value) {
+    return (long long)nearbyint((double)value * 100.0);
+}
+
+// Writes a whole number of hundredths (places 2) or thousandths (places 3) of a mm as a decimal number. Short drops
+// the trailing zeros ("12.50" -> "12.5", "3.00" -> "3").
+static char *PutDecimal(char *out, long long units, int places, int negative, int short_form) {
+    char digits[24];
+    int n = 0;
+
+    if (negative) {
+        *out++ = '-';
+    }
+    unsigned long long magnitude = units < 0 ? -(unsigned long long)units : (unsigned long long)units;
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0 || n <= places); // At least "0.00" or "0.000"
+
+    while (n > places) {
+        *out++ = digits[--n];
+    }
+    int last = 0; // Lowest decimal place written
+    while (short_form && last < places && digits[last] == '0') {
+        last++;
+    }
+    if (last < places) {
+        *out++ = '.';
+        while (n > last) {
+            *out++ = digits[--n];
+        }
+    }
+    return out;
+}
+
+//Writes a coordinate in mm the way printf's "%.2f" does, without going through printf, so the digits come out the
+//same on every platform. Returns where the text ends.
+char *FormatHundredths(char *out, float value) {
+    // printf keeps the sign of a negative number that rounds to zero
+    return PutDecimal(out, ToHundredths(value), 2, signbit(value), 0);
+}
+
+// Adds " S0" or " S1000" for a pen change that was saved up to go out with the next move
+static char *PutPenWord(GCodeEmitter *emitter, char *out) {
+    if (emitter->pen_word >= 0) {
+        out += sprintf(out, out == emitter->buffer ? "S%d" : " S%d", emitter->pen_word);
+        emitter->pen_word = -1;
+    }
+    return out;
+}
+
+// The feed rate a move of the given mode runs at
+static int MoveFeed(const GCodeEmitter *emitter, int mode) {
+    return mode == 0 && emitter->travel_feed > 0 ? emitter->travel_feed : emitter->draw_feed;
+}
+
+// Adds " F..." if the move runs at a different feed from the last one sent
+static char *PutFeed(GCodeEmitter *emitter, char *out, int mode) {
+    int feed = MoveFeed(emitter, mode);
+    if (feed != emitter->sent_feed) {
+        out += sprintf(out, " F%d", feed);
+        emitter->sent_feed = feed;
+    }
+    return out;
+}
+
+// Adds the time a move going (dx, dy) takes at its feed rate to the job's total, length is longer for an arc
+static void AddMoveTime(GCodeEmitter *emitter, int mode, double dx, double dy, double length) {
+    if (emitter->estimator) {
+        EstimateMove(emitter->estimator, (float)dx, (float)dy, (float)length, MoveFeed(emitter, mode));
+    }
+    double seconds = length * 60.0 / MoveFeed(emitter, mode);
+    if (mode == 0) {
+        emitter->travel_seconds += seconds;
+    }
+    else {
+        emitter->draw_seconds += seconds;
+    }
+}
+
+// Adds one axis word to the words started at line, as a position or with relative set as the distance from the last
+// one sent. With compact output it is left out if the controller already has that value.
+static char *PutAxis(GCodeEmitter *emitter, char *line, char *out, char axis, float value, long long *sent,
+                     int relative) {
+    long long hundredths = ToHundredths(value);
+    if (emitter->compact && emitter->sent_mode >= 0 && hundredths == *sent) {
+        return out;
+    }
+    if (out != line) {
+        *out++ = ' ';
+    }
+    *out++ = axis;
+    if (relative) {
+        // Worked out from what was sent rather than where the pen really is, so rounding never adds up
+        long long delta = hundredths - *sent;
+        out = PutDecimal(out, delta, 2, delta < 0, emitter->compact);
+    }
+    else {
+        out = emitter->compact ? PutDecimal(out, hundredths, 2, hundredths < 0, 1) : FormatHundredths(out, value);
+    }
+    *sent = hundredths;
+    return out;
+}
+
+// Adds G90 or G91 if the move needs the other distance mode from the one the controller is in
+static char *PutDistanceMode(GCodeEmitter *emitter, char *out, int relative) {
+    if (relative != emitter->sent_relative) {
+        out += sprintf(out, relative ? "G91 " : "G90 ");
+        emitter->sent_relative = relative;
+    }
+    return out;
+}
+
+// Sends the move that was held back, if there is one. With compact output the G word is only written when the
+// motion mode changes and an axis only when it moves; a move that goes nowhere is not sent at all.
+static void FlushMove(GCodeEmitter *emitter) {
+    if (!emitter->pending) {
+        return;
+    }
+    emitter->pending = 0;
+
+    int mode = emitter->pending_pen == 1 ? 1 : 0;
+    char axes[40], deltas[40];
+    char *start = emitter->buffer;
+    char *out = start;
+
+    // The axes are worked out first, they decide whether the G word is needed
+    long long sent_x = emitter->sent_x, sent_y = emitter->sent_y;
+    char *end = axes;
+    end = PutAxis(emitter, axes, end, 'X', emitter->x, &sent_x, 0);
+    end = PutAxis(emitter, axes, end, 'Y', emitter->y, &sent_y, 0);
+    size_t length = end - axes;
+    if (length == 0 && emitter->pen_word < 0) {
+        return;
+    }
+
+    // A move goes as a distance when that is shorter, counting the G90 or G91 it would take to switch, so the
+    // controller stays in G91 inside strokes and moves back to positions far from the last point. Every
+    // RELATIVE_RESYNC moves an absolute position is sent anyway, in case the controller rounds differently to us.
+    int relative = 0;
+    if (emitter->relative && length > 0 && emitter->sent_mode >= 0 && emitter->relative_moves < RELATIVE_RESYNC) {
+        long long delta_x = emitter->sent_x, delta_y = emitter->sent_y;
+        end = deltas;
+        end = PutAxis(emitter, deltas, end, 'X', emitter->x, &delta_x, 1);
+        end = PutAxis(emitter, deltas, end, 'Y', emitter->y, &delta_y, 1);
+        size_t switch_cost = 4; // "G90 " or "G91 "
+        if ((size_t)(end - deltas) + (emitter->sent_relative ? 0 : switch_cost) <
+            length + (emitter->sent_relative ? switch_cost : 0)) {
+            relative = 1;
+            length = end - deltas;
+            memcpy(axes, deltas, length);
+        }
+    }
+    if (length > 0) {
+        emitter->relative_moves = relative ? emitter->relative_moves + 1 : 0;
+    }
+
+    out = start;
+    if (length > 0) {
+        out = PutDistanceMode(emitter, out, relative);
+    }
+    if (length > 0 && (!emitter->compact || mode != emitter->sent_mode)) {
+        *out++ = 'G';
+        *out++ = (char)('0' + mode);
+        *out++ = ' ';
+        emitter->sent_mode = mode;
+    }
+    memcpy(out, axes, length);
+    out += length;
+    if (length > 0) {
+        out = PutFeed(emitter, out, mode);
+        double dx = (sent_x - emitter->sent_x) / 100.0, dy = (sent_y - emitter->sent_y) / 100.0;
+        AddMoveTime(emitter, mode, dx, dy, hypot(dx, dy));
+    }
+    out = PutPenWord(emitter, out);
+    *out++ = '\n';
+    *out = '\0';
+    emitter->sent_x = sent_x;
+    emitter->sent_y = sent_y;
+    Send(emitter);
+}
+
+// Only write S0 or S1000 if the pen state changes. Folded pen changes go out on the next move's line, the
+// controller sets the pen before it moves. A dwell has to come between the two, so it stops pen changes folding.
+static void SetPen(GCodeEmitter *emitter, int pen) {
+    if (pen != emitter->pen) {
+        FlushMove(emitter); // The held move was made with the pen as it was
+        if (emitter->estimator) {
+            EstimateStop(emitter->estimator, emitter->pen_dwell);
+        }
+        if (emitter->fold_pen && emitter->pen_dwell <= 0) {
+            emitter->pen_word = pen == 1 ? 1000 : 0;
+        }
+        else {
+            char *out = emitter->buffer + sprintf(emitter->buffer, pen == 1 ? "S1000\n" : "S0\n");
+            if (emitter->pen_dwell > 0) {
+                // G4 P is in seconds on GRBL
+                out = FormatHundredths(out + sprintf(out, "G4 P"), emitter->pen_dwell);
+                sprintf(out, "\n");
+                emitter->dwell_seconds += emitter->pen_dwell;
+            }
+            Send(emitter);
+        }
+        emitter->pen = pen; // Update previous pen state
+    }
+}
+
+// Whether a G1 to (x, y) carries straight on from the held one: it turns by no more than the angle tolerance from the
+// run's first segment and ends within the distance tolerance of that segment's line, and the held end and every
+// point the run dropped before it stay within the distance tolerance of the one move from the run's start to (x, y).
+// Checking them all again stops a slow curve creeping away a little at each merge.
+static int Straight(const GCodeEmitter *emitter, float x, float y) {
+    float dx = x - emitter->x, dy = y - emitter->y;
+    float length = sqrtf(dx * dx + dy * dy);
+    if (length == 0) {
+        return 1; // Going nowhere
+    }
+    float turn = (dx * emitter->direction_x + dy * emitter->direction_y) / length;
+    float off_line = fabsf((x - emitter->run_x) * emitter->direction_y - (y - emitter->run_y) * emitter->direction_x);
+    if (turn < emitter->merge_cos || off_line > emitter->merge_distance || emitter->run_count == MERGE_RUN_POINTS) {
+        return 0;
+    }
+    float chord_x = x - emitter->run_x, chord_y = y - emitter->run_y;
+    float chord = sqrtf(chord_x * chord_x + chord_y * chord_y);
+    if (chord == 0) {
+        return 0; // Back where the run started
+    }
+    float limit = emitter->merge_distance * chord;
+    if (fabsf((emitter->x - emitter->run_x) * chord_y - (emitter->y - emitter->run_y) * chord_x) > limit) {
+        return 0;
+    }
+    for (int i = 0; i < emitter->run_count; i++) {
+        const StrokePoint *point = &emitter->run_points[i];
+        if (fabsf((point->x - emitter->run_x) * chord_y - (point->y - emitter->run_y) * chord_x) > limit) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void MoveTo(GCodeEmitter *emitter, float x, float y) {
+    if (emitter->merge && emitter->pending && emitter->pending_pen == emitter->pen) {
+        // Only the last of a run of G0s matters, and a G1 going straight on just makes the held one longer
+        if (emitter->pen != 1 || Straight(emitter, x, y)) {
+            if (emitter->pen == 1 && (x != emitter->x || y != emitter->y)) {
+                emitter->run_points[emitter->run_count].x = emitter->x;
+                emitter->run_points[emitter->run_count].y = emitter->y;
+                emitter->run_count++;
+            }
+            emitter->x = x;
+            emitter->y = y;
+            emitter->removed++;
+            return;
+        }
+    }
+    FlushMove(emitter);
+
+    float dx = x - emitter->x, dy = y - emitter->y;
+    float length = sqrtf(dx * dx + dy * dy);
+    emitter->run_x = emitter->x;
+    emitter->run_y = emitter->y;
+    emitter->run_count = 0;
+    emitter->direction_x = length > 0 ? dx / length : 0;
+    emitter->direction_y = length > 0 ? dy / length : 0;
+    emitter->pending = 1;
+    emitter->pending_pen = emitter->pen;
+    emitter->x = x;
+    emitter->y = y;
+    if (!emitter->merge) {
+        FlushMove(emitter);
+    }
+}
+
+void StartGCode(GCodeEmitter *emitter, char *buffer, void (*send)(char *buffer)) {
+    emitter->buffer = buffer;
+    emitter->send = send;
+    emitter->pen = -1;
+    emitter->x = 0;
+    emitter->y = 0;
+    emitter->lines = 0;
+    emitter->bytes = 0;
+    emitter->merge = 0;
+    emitter->pending = 0;
+    emitter->run_count = 0;
+    emitter->removed = 0;
+    emitter->arc_tolerance = 0;
+    emitter->compact = 0;
+    emitter->fold_pen = 0;
+    emitter->sent_mode = -1;
+    emitter->sent_x = emitter->sent_y = 0;
+    emitter->pen_word = -1;
+    emitter->relative = 0;
+    emitter->sent_relative = 0; // Controllers start up in G90
+    emitter->relative_moves = 0;
+    emitter->arcs = 0;
+    emitter->arc_moves = 0;
+    emitter->draw_feed = emitter->sent_feed = DEFAULT_FEED;
+    emitter->travel_feed = 0;
+    emitter->pen_dwell = 0;
+    emitter->draw_seconds = emitter->travel_seconds = emitter->dwell_seconds = 0;
+    emitter->estimator = NULL;
+    emitter->record = NULL;
+
+    sprintf(buffer, "F%d\nM3\n", DEFAULT_FEED); // Initialize G-code
+    Send(emitter);
+}
+
+//Merges moves before they are sent: runs of G1s that go straight on within the tolerances become one G1, and of a
+//run of G0s only the last is sent. Repeated S0/S1000 lines are never sent in the first place.
+void MergeMoves(GCodeEmitter *emitter, float distance, float angle_degrees) {
+    emitter->merge = 1;
+    emitter->merge_distance = distance;
+    emitter->merge_cos = cosf(angle_degrees * (float)M_PI / 180.0f);
+}
+
+//Sends less from now on: G words and axes the controller already has are left out, and so are trailing zeros.
+//With fold_pen the S0/S1000 for a pen change goes on the line of the move after it.
+void CompactGCode(GCodeEmitter *emitter, int fold_pen) {
+    emitter->compact = 1;
+    emitter->fold_pen = fold_pen;
+}
+
+//Sends moves as G91 distances from the last point from now on wherever that is shorter, which inside a stroke it is
+//once the pen is far down the page. An absolute position is sent at least every RELATIVE_RESYNC moves.
+void RelativeMoves(GCodeEmitter *emitter) {
+    emitter->relative = 1;
+}
+
+//Draws at draw_feed and travels at travel_feed (mm/min, 0 to travel at the draw feed too) from now on, sending F
+//whenever the feed changes. After each pen change the robot waits pen_dwell seconds, 0 for not at all.
+void SetFeeds(GCodeEmitter *emitter, int draw_feed, int travel_feed, float pen_dwell) {
+    emitter->draw_feed = draw_feed;
+    emitter->travel_feed = travel_feed;
+    emitter->pen_dwell = pen_dwell;
+}
+
+//Tells the estimator about everything sent from now on, and about what StartGCode sent as one send. It should be
+//started already.
+void EstimateGCode(GCodeEmitter *emitter, Estimator *estimator) {
+    emitter->estimator = estimator;
+    EstimateSend(estimator, emitter->bytes);
+}
+
+//Writes a copy of every command sent from now on to file, starting with what StartGCode sent (still in the buffer),
+//so it has to be called straight after StartGCode.
+void RecordGCode(GCodeEmitter *emitter, FILE *file) {
+    emitter->record = file;
+    fwrite(emitter->buffer, 1, strlen(emitter->buffer) + 1, file);
+}
+
+//Fits arcs to the drawn runs from now on, as long as no point is further than tolerance (mm) from the arc and the
+//arc strays no further than that from the moves it replaces. The robot's firmware has to accept G2/G3.
+void FitArcs(GCodeEmitter *emitter, float tolerance) {
+    emitter->arc_tolerance = tolerance;
+}
+
+// The circle through three points (worked out relative to the first, in double so far down the page still works).
+// Returns 0 if the points are in a line or the circle is too big to be worth it.
+static int CircleThrough(const StrokePoint *a, const StrokePoint *b, const StrokePoint *c,
+                         double *centre_x, double *centre_y, double *radius) {
+    double bx = b->x - a->x, by = b->y - a->y;
+    double cx = c->x - a->x, cy = c->y - a->y;
+    double d = 2 * (bx * cy - by * cx);
+    if (fabs(d) < 1e-9) {
+        return 0;
+    }
+    double ux = (cy * (bx * bx + by * by) - by * (cx * cx + cy * cy)) / d;
+    double uy = (bx * (cx * cx + cy * cy) - cx * (bx * bx + by * by)) / d;
+    *radius = sqrt(ux * ux + uy * uy);
+    *centre_x = a->x + ux;
+    *centre_y = a->y + uy;
+    return *radius <= ARC_MAX_RADIUS;
+}
+
+// Whether points[0..last] all go round the circle one way, each point within tolerance of it and each move's chord
+// within tolerance of the arc over it. Sets clockwise to which way they go.
+static int OnArc(const StrokePoint *points, int last, double centre_x, double centre_y, double radius,
+                 float tolerance, int *clockwise) {
+    double sweep = 0;
+    for (int k = 0; k < last; k++) {
+        double ax = points[k].x - centre_x, ay = points[k].y - centre_y;
+        double bx = points[k + 1].x - centre_x, by = points[k + 1].y - centre_y;
+        if (fabs(sqrt(bx * bx + by * by) - radius) > tolerance) {
+            return 0;
+        }
+        double step = atan2(ax * by - ay * bx, ax * bx + ay * by);
+        if (step == 0 || fabs(step) > ARC_MAX_STEP || (k > 0 && (step < 0) != *clockwise)) {
+            return 0;
+        }
+        *clockwise = step < 0;
+
+        // How far the arc bulges out past the straight move
+        double chord = hypot(bx - ax, by - ay);
+        if (radius - sqrt(fmax(radius * radius - chord * chord / 4, 0)) > tolerance) {
+            return 0;
+        }
+        sweep += fabs(step);
+    }
+    return sweep < ARC_MAX_SWEEP;
+}
+
+// Adds " I0.125" or similar, an arc centre's offset from the start to the nearest thousandth of a mm. Rounded here
+// rather than by printf, so the digits are the same on every platform. Compact output drops the trailing zeros.
+static char *PutOffset(const GCodeEmitter *emitter, char *out, char axis, double offset) {
+    long long thousandths = (long long)nearbyint(offset * 1000.0);
+    *out++ = ' ';
+    *out++ = axis;
+    return PutDecimal(out, thousandths, 3, emitter->compact ? thousandths < 0 : signbit(offset), emitter->compact);
+}
+
+// Sends one arc from the pen's position to end. The centre is moved onto the line halfway between the start and end
+// as they are printed, so both are the same distance from it and the firmware does not reject the arc.
+static void SendArc(GCodeEmitter *emitter, const StrokePoint *end, double centre_x, double centre_y, int clockwise) {
+    double start_x = ToHundredths(emitter->x) / 100.0, start_y = ToHundredths(emitter->y) / 100.0;
+    double end_x = ToHundredths(end->x) / 100.0, end_y = ToHundredths(end->y) / 100.0;
+    double mid_x = (start_x + end_x) / 2, mid_y = (start_y + end_y) / 2;
+    double length = hypot(end_x - start_x, end_y - start_y);
+    double normal_x = -(end_y - start_y) / length, normal_y = (end_x - start_x) / length;
+    double along = (centre_x - mid_x) * normal_x + (centre_y - mid_y) * normal_y;
+    centre_x = mid_x + along * normal_x;
+    centre_y = mid_y + along * normal_y;
+
+    double sweep = atan2(end_y - centre_y, end_x - centre_x) - atan2(start_y - centre_y, start_x - centre_x);
+    if (clockwise) {
+        sweep = -sweep;
+    }
+    if (sweep <= 0) {
+        sweep += 2 * M_PI;
+    }
+
+    // The end goes like a G1's, so compact output leaves out the G word and an axis that does not change. The
+    // start and end never print the same, so at least one axis is always there and the arc is never a full circle.
+    FlushMove(emitter);
+    int mode = clockwise ? 2 : 3;
+    char axes[40];
+    char *axes_end = PutAxis(emitter, axes, axes, 'X', end->x, &emitter->sent_x, 0);
+    axes_end = PutAxis(emitter, axes, axes_end, 'Y', end->y, &emitter->sent_y, 0);
+    char *out = PutDistanceMode(emitter, emitter->buffer, 0); // Arcs always give their end as a position
+    emitter->relative_moves = 0;
+    if (!emitter->compact || mode != emitter->sent_mode) {
+        *out++ = 'G';
+        *out++ = (char)('0' + mode);
+        *out++ = ' ';
+        emitter->sent_mode = mode;
+    }
+    memcpy(out, axes, axes_end - axes);
+    out += axes_end - axes;
+    out = PutOffset(emitter, out, 'I', centre_x - start_x);
+    out = PutOffset(emitter, out, 'J', centre_y - start_y);
+    out = PutFeed(emitter, out, 1);
+    out = PutPenWord(emitter, out);
+    *out++ = '\n';
+    *out = '\0';
+    AddMoveTime(emitter, 1, end_x - start_x, end_y - start_y, sweep * hypot(start_x - centre_x, start_y - centre_y));
+    Send(emitter);
+    emitter->x = end->x;
+    emitter->y = end->y;
+}
+
+// Draws a run of points with the pen down from points[0], where the pen is. Each time, the longest run of at least
+// ARC_MIN_MOVES moves that lies on an arc goes as one G2/G3, anything else as G1s.
+static void DrawRun(GCodeEmitter *emitter, const StrokePoint *points, int count) {
+    int i = 0;
+    while (i < count - 1) {
+        int best = -1, best_clockwise = 0;
+        double best_x = 0, best_y = 0;
+        for (int j = i + ARC_MIN_MOVES; j < count; j++) {
+            double centre_x, centre_y, radius;
+            int clockwise = 0;
+            if (!CircleThrough(&points[i], &points[(i + j) / 2], &points[j], &centre_x, &centre_y, &radius) ||
+                !OnArc(&points[i], j - i, centre_x, centre_y, radius, emitter->arc_tolerance, &clockwise) ||
+                hypot(points[j].x - points[i].x, points[j].y - points[i].y) < 2 * SAME_POINT ||
+                (ToHundredths(points[j].x) == ToHundredths(emitter->x) &&
+                 ToHundredths(points[j].y) == ToHundredths(emitter->y))) {
+                break;
+            }
+            best = j;
+            best_clockwise = clockwise;
+            best_x = centre_x;
+            best_y = centre_y;
+        }
+
+        if (best < 0) {
+            MoveTo(emitter, points[i + 1].x, points[i + 1].y);
+            i++;
+            continue;
+        }
+        SendArc(emitter, &points[best], best_x, best_y, best_clockwise);
+        emitter->arcs++;
+        emitter->arc_moves += best - i;
+        i = best;
+    }
+}
+
+//Draws each stroke in turn, lifting the pen to travel to its start unless the pen is already there
+void EmitStrokes(GCodeEmitter *emitter, const StrokeList *list) {
+    for (int i = 0; i < list->num_strokes; i++) {
+        const StrokePoint *points = &list->points[list->strokes[i].first];
+        int count = list->strokes[i].count;
+
+        if (emitter->pen != 1 || fabsf(points[0].x - emitter->x) >= SAME_POINT || fabsf(points[0].y - emitter->y) >= SAME_POINT) {
+            SetPen(emitter, 0);
+            MoveTo(emitter, points[0].x, points[0].y);
+        }
+        SetPen(emitter, 1);
+        if (emitter->arc_tolerance > 0) {
+            DrawRun(emitter, points, count);
+            continue;
+        }
+        for (int j = 1; j < count; j++) {
+            MoveTo(emitter, points[j].x, points[j].y);
+        }
+    }
+}
+
+// Pen up and back to the origin, leaving the controller in G90
+static void GoHome(GCodeEmitter *emitter) {
+    SetPen(emitter, 0);
+    if (emitter->pending && emitter->pending_pen != 1) {
+        emitter->pending = 0; // A travel move straight before going home is not needed
+        emitter->removed++;
+    }
+    FlushMove(emitter);
+    if (emitter->compact || emitter->fold_pen || emitter->sent_relative || MoveFeed(emitter, 0) != emitter->sent_feed) {
+        // Through the same encoder as every other move, so the last pen lift can go out with it. Going home is
+        // always absolute, the controller is left in G90 for whatever is sent to it next.
+        emitter->relative = 0;
+        emitter->x = 0;
+        emitter->y = 0;
+        emitter->pending = 1;
+        emitter->pending_pen = 0;
+        FlushMove(emitter);
+        if (emitter->sent_relative) {
+            sprintf(emitter->buffer, "G90\n"); // Already home, nothing went out to switch back with
+            Send(emitter);
+            emitter->sent_relative = 0;
+        }
+        return;
+    }
+    sprintf(emitter->buffer, "G0 X0 Y0\n");
+    AddMoveTime(emitter, 0, -emitter->x, -emitter->y, hypot(emitter->x, emitter->y));
+    Send(emitter);
+    emitter->x = 0;
+    emitter->y = 0;
+    emitter->sent_x = emitter->sent_y = 0; // A page after this may send distances from here
+}
+
+//Ends a page: the pen goes up and home as at the end of a job, then the page commands, if there are any, are sent as
+//they are. They may change anything on the controller, so the next move sends its G word and feed again.
+void PageBreak(GCodeEmitter *emitter, const char *commands) {
+    int relative = emitter->relative;
+    GoHome(emitter);
+    emitter->relative = relative;
+    if (commands) {
+        snprintf(emitter->buffer, GCODE_BUFFER_SIZE, "%s\n", commands);
+        Send(emitter);
+        emitter->sent_mode = -1;
+        emitter->sent_feed = -1;
+    }
+}
+
+//Ensure the pen is up and return to the origin at the end
+void FinishGCode(GCodeEmitter *emitter) {
+    GoHome(emitter);
+}
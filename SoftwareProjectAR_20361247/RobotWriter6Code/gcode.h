@@ -0,0 +1,70 @@
+#ifndef GCODE_H_INCLUDED
+#define GCODE_H_INCLUDED
+
+#include <stdio.h>
+#include "stroke.h"
+#include "estimate.h"
+
+#define SAME_POINT 0.005f         // Points closer than this (mm) print as the same coordinates
+#define DEFAULT_FEED 1000         // Feed rate (mm/min) every job starts with
+#define GCODE_BUFFER_SIZE 100     // Room the emitter needs in its buffer for any one command
+#define MERGE_RUN_POINTS 64       // Most points one merged G1 may stand in for
+
+//Turns stroke lists into G-code commands. The pen state and position carry over from one list to the next.
+typedef struct {
+    char *buffer;                 // Where each G-code command is written before it is sent
+    void (*send)(char *buffer);   // Sends one command on to the robot
+    int pen;                      // Track previous pen state (-1 = uninitialized)
+    float x, y;                   // Where the pen is
+    long lines;                   // G-code lines sent so far
+    long bytes;                   // Characters sent so far
+
+    // Peephole: each move is held back until the next one shows whether the two can go as one line
+    int merge;                    // Merge moves at all (off unless the job asks for it)
+    float merge_distance;         // Furthest (mm) a dropped point may be from the line that replaces it
+    float merge_cos;              // Cosine of the largest turn still counted as going straight on
+    int pending;                  // A move to (x, y) is held back
+    int pending_pen;              // Whether the held move is a G1 or a G0
+    float run_x, run_y;           // Where the held move starts from
+    float direction_x, direction_y; // Unit direction of the held run's first segment
+    StrokePoint run_points[MERGE_RUN_POINTS]; // Points the held G1 run has dropped so far
+    int run_count;
+    long removed;                 // Lines merged away
+
+    float arc_tolerance;          // Fit G2/G3 arcs to drawn runs within this distance (mm), 0 for none
+    long arcs, arc_moves;         // Arcs sent and the G1 moves they replaced
+
+    // Modal encoding: the controller remembers the motion mode and the position, so they need not be repeated
+    int compact;                  // Leave out unchanged G words and axes and trailing zeros
+    int fold_pen;                 // Send S0/S1000 on the next move's line instead of a line of its own
+    int sent_mode;                // Last G0/G1/G2/G3 sent, -1 before the first
+    long long sent_x, sent_y;     // Last X and Y sent, in hundredths of a mm
+    int pen_word;                 // S value waiting to go out with the next move, -1 for none
+    int relative;                 // Send moves as G91 distances when shorter
+    int sent_relative;            // Whether the controller is in G91
+    int relative_moves;           // Relative moves since the last absolute position
+
+    // Feeds: the robot's sketch runs G0 at the feed rate like any other move, so travel gets its own F
+    int draw_feed;                // Feed rate (mm/min) with the pen down
+    int travel_feed;              // Feed rate (mm/min) with the pen up, 0 for the draw feed
+    float pen_dwell;              // Seconds to wait (G4) after each pen change for the servo to settle
+    int sent_feed;                // Last F sent
+    double draw_seconds, travel_seconds, dwell_seconds; // Time the G-code sent so far takes at those feeds
+    Estimator *estimator;         // Told about every move, pen change and send, NULL for none
+    FILE *record;                 // Every command sent is also written here with a '\0' after it, NULL for none
+} GCodeEmitter;
+
+void StartGCode(GCodeEmitter *emitter, char *buffer, void (*send)(char *buffer)); // Sends the G-code that starts a job
+void EmitStrokes(GCodeEmitter *emitter, const StrokeList *list);
+void MergeMoves(GCodeEmitter *emitter, float distance, float angle_degrees);     // Turn on the peephole
+void FitArcs(GCodeEmitter *emitter, float tolerance);                            // Send curved runs as G2/G3
+void CompactGCode(GCodeEmitter *emitter, int fold_pen);                          // Leave out what has not changed
+void RelativeMoves(GCodeEmitter *emitter);                                       // Draw with G91 distances
+void SetFeeds(GCodeEmitter *emitter, int draw_feed, int travel_feed, float pen_dwell); // Speeds and pen wait
+void EstimateGCode(GCodeEmitter *emitter, Estimator *estimator);                 // Work out how long it all takes
+void RecordGCode(GCodeEmitter *emitter, FILE *file);                             // Keep a copy of what is sent
+char *FormatHundredths(char *out, float value);   // Write a coordinate like "%.2f" does, returns the end of it
+void PageBreak(GCodeEmitter *emitter, const char *commands);                     // Home between pages, then commands
+void FinishGCode(GCodeEmitter *emitter);                                         // Pen up and back to the origin
+
+#endif // GCODE_H_INCLUDED
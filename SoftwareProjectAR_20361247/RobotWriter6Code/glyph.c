@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "glyph.h"
+
+// A run of points drawn without lifting the pen. A stroke with a single point is a dot.
+typedef struct {
+    int first;
+    int count;
+} GlyphStroke;
+
+// Splits a character into pen-down strokes. Zero-length segments are dropped and collinear runs are merged on the way.
+static int SplitStrokes(const FontData *glyph, Movement *points, GlyphStroke *strokes) {
+    int x = 0, y = 0;          // Every character starts at its own origin
+    int num_points = 0, num_strokes = 0;
+    int drawing = 0;
+
+    for (int i = 0; i < glyph->num_movements; i++) {
+        const Movement *move = &glyph->movements[i];
+        if (move->pen != 1) {
+            drawing = 0; // Any pen-up move ends the stroke, only the last of a run of them matters
+            x = move->x;
+            y = move->y;
+            continue;
+        }
+
+        if (!drawing) {
+            strokes[num_strokes].first = num_points;
+            strokes[num_strokes].count = 1;
+            points[num_points].x = x;
+            points[num_points].y = y;
+            points[num_points].pen = 1;
+            num_points++;
+            num_strokes++;
+            drawing = 1;
+        }
+
+        GlyphStroke *stroke = &strokes[num_strokes - 1];
+        Movement *last = &points[stroke->first + stroke->count - 1];
+        x = move->x;
+        y = move->y;
+
+        // A segment that goes nowhere
+        if (x == last->x && y == last->y) {
+            continue;
+        }
+
+        // A segment carrying straight on from the previous one just extends it
+        if (stroke->count >= 2) {
+            const Movement *before = last - 1;
+            long cross = (long)(last->x - before->x) * (y - last->y) - (long)(last->y - before->y) * (x - last->x);
+            long dot = (long)(last->x - before->x) * (x - last->x) + (long)(last->y - before->y) * (y - last->y);
+            if (cross == 0 && dot > 0) {
+                last->x = x;
+                last->y = y;
+                continue;
+            }
+        }
+
+        points[num_points].x = x;
+        points[num_points].y = y;
+        points[num_points].pen = 1;
+        num_points++;
+        stroke->count++;
+    }
+    return num_strokes;
+}
+
+static float Distance(int x1, int y1, int x2, int y2) {
+    return sqrtf((float)(x2 - x1) * (x2 - x1) + (float)(y2 - y1) * (y2 - y1));
+}
+
+// Total pen-up travel of a stroke order, from the origin through every stroke to the advance point
+static float OrderTravel(const Movement *points, const GlyphStroke *strokes, const int *order, const int *reversed,
+                         int num_strokes, int advance) {
+    int x = 0, y = 0;
+    float travel = 0;
+    for (int i = 0; i < num_strokes; i++) {
+        const GlyphStroke *stroke = &strokes[order[i]];
+        const Movement *start = &points[stroke->first + (reversed[i] ? stroke->count - 1 : 0)];
+        const Movement *end = &points[stroke->first + (reversed[i] ? 0 : stroke->count - 1)];
+        travel += Distance(x, y, start->x, start->y);
+        x = end->x;
+        y = end->y;
+    }
+    return travel + Distance(x, y, advance, 0);
+}
+
+// Greedy nearest-neighbour order that starts with the given stroke, each following stroke drawn in whichever
+// direction starts closer to where the pen is
+static void GreedyOrder(const Movement *points, const GlyphStroke *strokes, int num_strokes, int first, int first_reversed,
+                        int *order, int *reversed) {
+    int used[MAX_MOVEMENTS] = {0};
+    order[0] = first;
+    reversed[0] = first_reversed;
+    used[first] = 1;
+
+    for (int i = 1; i < num_strokes; i++) {
+        const GlyphStroke *previous = &strokes[order[i - 1]];
+        const Movement *end = &points[previous->first + (reversed[i - 1] ? 0 : previous->count - 1)];
+        float best = -1;
+        for (int j = 0; j < num_strokes; j++) {
+            if (used[j]) {
+                continue;
+            }
+            const Movement *head = &points[strokes[j].first];
+            const Movement *tail = &points[strokes[j].first + strokes[j].count - 1];
+            float forward = Distance(end->x, end->y, head->x, head->y);
+            float backward = Distance(end->x, end->y, tail->x, tail->y);
+            if (best < 0 || forward < best) {
+                best = forward;
+                order[i] = j;
+                reversed[i] = 0;
+            }
+            if (backward < best) {
+                best = backward;
+                order[i] = j;
+                reversed[i] = 1;
+            }
+        }
+        used[order[i]] = 1;
+    }
+}
+
+// Rewrites the character's movements: zero-length segments, collinear points and pen-up moves that go nowhere are
+// removed, and the strokes are reordered (and reversed where that helps) for the least pen-up travel.
+// The last movement is still the pen-up move to the advance point, as the layout expects.
+void OptimiseGlyph(FontData *glyph) {
+    Movement points[MAX_GLYPH_POINTS];
+    GlyphStroke strokes[MAX_MOVEMENTS];
+    int order[MAX_MOVEMENTS], reversed[MAX_MOVEMENTS];
+    int best_order[MAX_MOVEMENTS] = {0}, best_reversed[MAX_MOVEMENTS] = {0};
+
+    int num_strokes = SplitStrokes(glyph, points, strokes);
+
+    // Start with the font's own order, then try a greedy order from every stroke in both directions
+    for (int i = 0; i < num_strokes; i++) {
+        best_order[i] = i;
+        best_reversed[i] = 0;
+    }
+    float best_travel = OrderTravel(points, strokes, best_order, best_reversed, num_strokes, glyph->advance);
+    for (int first = 0; first < num_strokes; first++) {
+        for (int direction = 0; direction < 2; direction++) {
+            GreedyOrder(points, strokes, num_strokes, first, direction, order, reversed);
+            float travel = OrderTravel(points, strokes, order, reversed, num_strokes, glyph->advance);
+            if (travel < best_travel) {
+                best_travel = travel;
+                for (int i = 0; i < num_strokes; i++) {
+                    best_order[i] = order[i];
+                    best_reversed[i] = reversed[i];
+                }
+            }
+        }
+    }
+
+    // Leave the character alone in the unlikely case the rewrite would not fit (one extra move per dot)
+    int needed = 1;
+    for (int i = 0; i < num_strokes; i++) {
+        needed += strokes[i].count + (strokes[i].count == 1);
+    }
+    if (needed > MAX_MOVEMENTS) {
+        return;
+    }
+
+    // Write the strokes back as movements. A stroke that starts where the last one ended needs no pen lift,
+    // except for the first one: the pen is not at this character's origin yet when it starts.
+    int n = 0;
+    int x = 0, y = 0;
+    for (int i = 0; i < num_strokes; i++) {
+        const GlyphStroke *stroke = &strokes[best_order[i]];
+        for (int k = 0; k < stroke->count; k++) {
+            const Movement *point = &points[stroke->first + (best_reversed[i] ? stroke->count - 1 - k : k)];
+            if (k == 0) {
+                if (i > 0 && point->x == x && point->y == y) {
+                    continue;
+                }
+                glyph->movements[n].pen = 0;
+            }
+            else if (n >= 2 && glyph->movements[n - 1].pen == 1) {
+                // Joining two strokes can line up another collinear run
+                const Movement *a = &glyph->movements[n - 2];
+                const Movement *b = &glyph->movements[n - 1];
+                long cross = (long)(b->x - a->x) * (point->y - b->y) - (long)(b->y - a->y) * (point->x - b->x);
+                long dot = (long)(b->x - a->x) * (point->x - b->x) + (long)(b->y - a->y) * (point->y - b->y);
+                if (cross == 0 && dot > 0) {
+                    n--;
+                }
+                glyph->movements[n].pen = 1;
+            }
+            else {
+                glyph->movements[n].pen = 1;
+            }
+            glyph->movements[n].x = point->x;
+            glyph->movements[n].y = point->y;
+            x = point->x;
+            y = point->y;
+            n++;
+        }
+
+        // A dot is a pen-down move on the spot
+        if (stroke->count == 1 && glyph->movements[n - 1].pen == 0) {
+            glyph->movements[n] = glyph->movements[n - 1];
+            glyph->movements[n].pen = 1;
+            n++;
+        }
+    }
+
+    // Finish with the move to where the next character starts
+    glyph->movements[n].x = glyph->advance;
+    glyph->movements[n].y = 0;
+    glyph->movements[n].pen = 0;
+    glyph->num_movements = n + 1;
+}
+
+// Distance from point p to the segment a-b (to a itself if the segment has no length, as for a closed loop)
+static float SegmentDistance(const Movement *p, const Movement *a, const Movement *b) {
+    float dx = (float)(b->x - a->x), dy = (float)(b->y - a->y);
+    float length_squared = dx * dx + dy * dy;
+    float t = 0;
+    if (length_squared > 0) {
+        t = ((p->x - a->x) * dx + (p->y - a->y) * dy) / length_squared;
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    }
+    float ex = a->x + t * dx - p->x, ey = a->y + t * dy - p->y;
+    return sqrtf(ex * ex + ey * ey);
+}
+
+// Marks the points between first and last that have to stay for the polyline to stay within tolerance
+static void DouglasPeucker(const Movement *points, int first, int last, float tolerance, int *keep) {
+    float furthest = 0;
+    int index = -1;
+    for (int i = first + 1; i < last; i++) {
+        float distance = SegmentDistance(&points[i], &points[first], &points[last]);
+        if (distance > furthest) {
+            furthest = distance;
+            index = i;
+        }
+    }
+    if (index >= 0 && furthest > tolerance) {
+        keep[index] = 1;
+        DouglasPeucker(points, first, index, tolerance, keep);
+        DouglasPeucker(points, index, last, tolerance, keep);
+    }
+}
+
+// Simplifies every pen-down run of the character so no drawn point moves further than tolerance (in font units)
+// from where the font put it. Pen-up moves, dots and the advance move are left as they are.
+void SimplifyGlyph(FontData *glyph, float tolerance) {
+    Movement points[MAX_MOVEMENTS + 1];
+    int keep[MAX_MOVEMENTS + 1];
+    Movement start = {0, 0, 0};  // Where the pen is before the run, every character starts at its own origin
+    int n = 0;
+
+    for (int i = 0; i < glyph->num_movements; ) {
+        if (glyph->movements[i].pen != 1) {
+            start = glyph->movements[i];
+            glyph->movements[n++] = glyph->movements[i++];
+            continue;
+        }
+
+        // Collect the run of pen-down moves together with the point it starts from
+        int count = 0;
+        points[count++] = start;
+        while (i < glyph->num_movements && glyph->movements[i].pen == 1) {
+            points[count++] = glyph->movements[i++];
+        }
+
+        for (int k = 0; k < count; k++) {
+            keep[k] = k == 0 || k == count - 1;
+        }
+        DouglasPeucker(points, 0, count - 1, tolerance, keep);
+
+        for (int k = 1; k < count; k++) {
+            if (keep[k]) {
+                glyph->movements[n++] = points[k];
+            }
+        }
+        start = points[count - 1];
+    }
+    glyph->num_movements = n;
+}
+
+// Turns the movements into the strokes the layout draws: each pen-down run, with the point the pen was at before
+// it, exactly as the movements put them. Has to be called again whenever the movements change.
+void PrepareGlyphPoints(FontData *glyph) {
+    int x = 0, y = 0;          // Every character starts at its own origin
+    int drawing = 0;
+    glyph->num_points = glyph->num_strokes = 0;
+
+    for (int i = 0; i < glyph->num_movements; i++) {
+        const Movement *move = &glyph->movements[i];
+        if (move->pen == 1) {
+            if (!drawing) {
+                glyph->stroke_first[glyph->num_strokes] = glyph->num_points;
+                glyph->stroke_count[glyph->num_strokes++] = 1;
+                glyph->point_x[glyph->num_points] = (float)x;
+                glyph->point_y[glyph->num_points++] = (float)y;
+                drawing = 1;
+            }
+            glyph->point_x[glyph->num_points] = (float)move->x;
+            glyph->point_y[glyph->num_points++] = (float)move->y;
+            glyph->stroke_count[glyph->num_strokes - 1]++;
+        }
+        else {
+            drawing = 0;
+        }
+        x = move->x;
+        y = move->y;
+    }
+}
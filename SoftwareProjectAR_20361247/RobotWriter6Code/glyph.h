@@ -0,0 +1,11 @@
+#ifndef GLYPH_H_INCLUDED
+#define GLYPH_H_INCLUDED
+
+#include "font.h"
+
+//Passes that rewrite a character's movements once, when the character is loaded, so every job gets the result for free
+void OptimiseGlyph(FontData *glyph);        // Merge collinear runs, drop useless moves and order strokes for least pen-up travel
+void SimplifyGlyph(FontData *glyph, float tolerance); // Douglas-Peucker: drop points within tolerance (font units) of the line
+void PrepareGlyphPoints(FontData *glyph);   // Fill in the strokes the layout draws from the movements
+
+#endif // GLYPH_H_INCLUDED
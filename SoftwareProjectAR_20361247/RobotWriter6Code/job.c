@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include "job.h"
+#include "jobcache.h"
+#include "fit.h"
+#include "layout.h"
+#include "optimise.h"
+#include "workspace.h"
+
+#define FIT_CHECKS 10             // Heights the --fit search may have to step down through before giving up
+
+static double Seconds(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Whether the page the layout is on is one of the pages the job sends
+static int SendingPage(const Job *job) {
+    const JobOptions *options = job->options;
+    return job->page + 1 >= options->first_page && (options->last_page == 0 || job->page + 1 <= options->last_page);
+}
+
+// The layout has moved on to a new page
+static void TurnPage(int page, void *context) {
+    Job *job = context;
+    job->page = page;
+}
+
+// Before the first strokes of a page: unless it is the first page sent, the pen goes home and the robot gets the
+// page commands, or waits while the paper is changed
+static void StartPage(Job *job) {
+    if (job->stats.pages > 0) {
+        PageBreak(&job->emitter, job->options->page_gcode);
+        if (job->options->change_paper) {
+            job->options->change_paper(job->page + 1);
+        }
+    }
+    job->sent_page = job->page;
+    job->stats.pages++;
+}
+
+//Runs every pass over a batch of laid out strokes and sends the result. A batch never has more than one page in it.
+static void ProcessStrokes(StrokeList *strokes, void *context) {
+    Job *job = context;
+    if (job->failed || !SendingPage(job)) {
+        return;
+    }
+    if (job->page != job->sent_page) {
+        StartPage(job);
+    }
+    if (job->options->clip_workspace) {
+        long cut = ClipStrokes(strokes, &job->workspace, &job->clipped);
+        if (cut < 0) {
+            fprintf(stderr, "Error: Out of memory clipping the strokes, the rest of the job is not sent.\n");
+            job->failed = 1;
+            return;
+        }
+        job->stats.clipped += cut;
+    }
+    job->stats.strokes += strokes->num_strokes;
+    job->stats.points += strokes->num_points;
+
+    clock_t start = clock();
+    job->stats.travel_before += PenUpTravel(strokes, job->emitter.x, job->emitter.y);
+    if (job->options->order_strokes) {
+        OrderStrokes(strokes, job->emitter.x, job->emitter.y, job->options->order_budget);
+    }
+    if (job->options->join_distance > 0) {
+        job->stats.joins += JoinStrokes(strokes, job->options->join_distance);
+    }
+    job->stats.travel_after += PenUpTravel(strokes, job->emitter.x, job->emitter.y);
+    job->stats.optimise_seconds += Seconds(start);
+
+    start = clock();
+    EmitStrokes(&job->emitter, strokes);
+    job->stats.emit_seconds += Seconds(start);
+}
+
+// Prints the estimate of how long the robot takes, which only needs the G-code to have gone through the estimator
+static void PrintEstimate(const Job *job, double seconds) {
+    long whole = (long)(seconds + 0.5);
+    printf("Estimate: %ld G-code lines, %ld bytes, %ld:%02ld:%02ld to write\n", job->emitter.lines, job->emitter.bytes,
+           whole / 3600, whole / 60 % 60, whole % 60);
+    printf("  moving %.1f s, pen changes %.1f s, waiting for the serial link %.1f s\n", job->estimator.move_seconds,
+           job->estimator.pause_seconds, job->estimator.wait_seconds);
+}
+
+static void PrintStats(const Job *job) {
+    printf("Job: %ld strokes, %ld points, %ld G-code lines, %ld bytes\n", job->stats.strokes, job->stats.points,
+           job->emitter.lines, job->emitter.bytes);
+    printf("  pen-up travel %.1f mm in text order, %.1f mm as drawn\n", job->stats.travel_before, job->stats.travel_after);
+    printf("  %ld of %ld lines copied from the same line earlier on\n", job->stats.copied_lines, job->stats.lines);
+    if (job->options->join_distance > 0) {
+        printf("  %ld pen lifts saved by joining strokes\n", job->stats.joins);
+    }
+    if (job->options->merge_moves) {
+        printf("  %ld G-code lines removed by merging moves (%.1f%%)\n", job->emitter.removed,
+               100.0 * job->emitter.removed / (job->emitter.lines + job->emitter.removed));
+    }
+    if (job->options->arc_tolerance > 0) {
+        printf("  %ld arcs sent in place of %ld moves\n", job->emitter.arcs, job->emitter.arc_moves);
+    }
+    if (job->options->clip_workspace) {
+        printf("  %ld strokes cut at the edge of the workspace\n", job->stats.clipped);
+    }
+    if (job->options->page_height > 0) {
+        printf("  %ld pages sent\n", job->stats.pages);
+    }
+    printf("  %.1f s at the feed rates: drawing %.1f s, travel %.1f s, pen dwell %.1f s\n",
+           job->emitter.draw_seconds + job->emitter.travel_seconds + job->emitter.dwell_seconds,
+           job->emitter.draw_seconds, job->emitter.travel_seconds, job->emitter.dwell_seconds);
+    printf("  layout %.3f s, optimise %.3f s, emit %.3f s\n", job->stats.layout_seconds, job->stats.optimise_seconds,
+           job->stats.emit_seconds);
+}
+
+// Only looks at where the strokes go
+static void MeasureStrokes(StrokeList *strokes, void *context) {
+    StrokeBounds(strokes, context);
+}
+
+// With --fit, the room each line leaves for the slant, worked out from the text the same way the search for the height
+// does. 0 if the job is not fitted or not slanted.
+static float FitSlantRoom(FILE *file, const Font *font, const JobOptions *options, float height) {
+    MeasuredText text;
+    if (options->fit_width <= 0 || options->slant == 0 || MeasureText(file, font, &text) != 0) {
+        return 0;
+    }
+    float room = SlantRoom(&text, options->slant, height);
+    FreeMeasuredText(&text);
+    return room;
+}
+
+// Lays the whole text out the way the job would, without sending anything, to find the box round everything it
+// draws. The file is rewound after. Returns -1 if the text has a character the font cannot draw.
+static int MeasureLayout(FILE *file, const Font *font, float height, const JobOptions *options, float slant_room,
+                         Box *box) {
+    Layout layout;
+    EmptyBox(box);
+    StartLayout(&layout, font, height, options->tolerance, MeasureStrokes, box);
+    layout.alternate_lines = options->alternate_lines;
+    layout.slant = options->slant;
+    if (options->line_width > 0) {
+        layout.max_width = options->line_width;
+    }
+    layout.slant_room = slant_room;
+    layout.page_height = options->page_height;
+    int result = StreamText(file, &layout);
+    FinishLayout(&layout);
+    rewind(file);
+    return result;
+}
+
+//Lays the whole text out without sending anything to find out if it all lies in the workspace, so a job that does
+//not fit is turned away before the robot starts it, not half way through. Returns -1 if it does not fit or has a
+//character the font cannot draw.
+static int CheckWorkspace(FILE *file, const Font *font, float height, const JobOptions *options, float slant_room,
+                          const Box *workspace) {
+    Box box;
+    if (MeasureLayout(file, font, height, options, slant_room, &box) != 0) {
+        return -1;
+    }
+    if (!BoxInside(&box, workspace)) {
+        printf("The text does not fit in the workspace: it goes from (%.2f, %.2f) to (%.2f, %.2f) mm, "
+               "the robot reaches (%.2f, %.2f) to (%.2f, %.2f) mm. Nothing was sent.\n", box.min_x, box.min_y,
+               box.max_x, box.max_y, workspace->min_x, workspace->min_y, workspace->max_x, workspace->max_y);
+        return -1;
+    }
+    return 0;
+}
+
+//Finds the largest height between min_height and max_height at which the text fits the --fit box, its lines
+//wrapped at the box's width less the slant room. The search only walks the words' widths; the height it lands on is
+//then laid out once, nothing sent, to be sure, and taken down a hundredth at a time if rounding left it just too big.
+//Returns 0 if the text does not fit or has a character the font cannot draw.
+float FitTextHeight(FILE *file, const Font *font, const JobOptions *options, float min_height, float max_height) {
+    MeasuredText text;
+    if (MeasureText(file, font, &text) != 0) {
+        return 0;
+    }
+    float height = FitHeight(&text, options->fit_width, options->fit_height, options->slant, min_height, max_height);
+
+    for (int tries = 0; height > 0 && tries < FIT_CHECKS; tries++) {
+        Box box;
+        if (MeasureLayout(file, font, height, options, SlantRoom(&text, options->slant, height), &box) != 0) {
+            break;
+        }
+        if (box.min_x > box.max_x ||
+            (box.max_x - box.min_x <= options->fit_width && box.max_y - box.min_y <= options->fit_height)) {
+            FreeMeasuredText(&text);
+            return height;
+        }
+        height = (float)(lroundf(height * 100) - 1) / 100;
+        height = height >= min_height ? height : 0;
+    }
+    FreeMeasuredText(&text);
+    return 0;
+}
+
+//Reads the text file a chunk at a time, lays it out with the font at the given height and sends the G-code.
+//With a cache a job that was written before is sent from there instead, and a new one is added to it.
+//With a workspace a job that goes outside it is refused before anything is sent, or clipped to it.
+//With a page height the text is split into pages, and only the pages asked for are sent.
+//Returns -1 if the text has a character the font cannot draw or a pass ran out of memory (the pen is still lifted
+//and sent home).
+int WriteText(FILE *file, const Font *font, float height, const JobOptions *options,
+              char *buffer, void (*send)(char *buffer)) {
+    Job job = {0};
+    Layout layout;
+    job.options = options;
+    job.sent_page = -1;
+
+    // An estimate needs the moves, so it always works the job out. So does a job that stops for the paper to be
+    // changed, the cache would send it straight through.
+    FILE *record = NULL;
+    unsigned long long key = 0;
+    int cached = options->cache_dir && !options->estimate && !options->change_paper;
+    if (cached) {
+        long lines, bytes;
+        key = JobKey(file, font, height, options);
+        if (SendCachedJob(options->cache_dir, key, buffer, send, &lines, &bytes) == 0) {
+            if (options->stats) {
+                printf("Job: sent from the cache, %ld G-code lines, %ld bytes\n", lines, bytes);
+            }
+            return 0;
+        }
+    }
+
+    // An arc may bulge out past the points it was fitted to by up to the arc tolerance
+    job.workspace = options->workspace;
+    job.workspace.min_x += options->arc_tolerance;
+    job.workspace.min_y += options->arc_tolerance;
+    job.workspace.max_x -= options->arc_tolerance;
+    job.workspace.max_y -= options->arc_tolerance;
+    float slant_room = FitSlantRoom(file, font, options, height);
+    if (options->check_workspace && !options->clip_workspace &&
+        CheckWorkspace(file, font, height, options, slant_room, &job.workspace) != 0) {
+        return -1;
+    }
+    InitStrokes(&job.clipped);
+    if (cached) {
+        record = BeginCachedJob(options->cache_dir, key);
+    }
+
+    StartGCode(&job.emitter, buffer, send);
+    if (record) {
+        RecordGCode(&job.emitter, record);
+    }
+    if (options->merge_moves) {
+        MergeMoves(&job.emitter, options->merge_distance, options->merge_angle);
+    }
+    FitArcs(&job.emitter, options->arc_tolerance);
+    if (options->compact) {
+        CompactGCode(&job.emitter, options->fold_pen);
+    }
+    if (options->relative) {
+        RelativeMoves(&job.emitter);
+    }
+    SetFeeds(&job.emitter, options->draw_feed, options->travel_feed, options->pen_dwell);
+    if (options->estimate || options->stats) {
+        StartEstimate(&job.estimator, options->acceleration, options->baud, options->send_seconds);
+        EstimateGCode(&job.emitter, &job.estimator);
+    }
+    clock_t start = clock();
+    StartLayout(&layout, font, height, options->tolerance, ProcessStrokes, &job);
+    layout.alternate_lines = options->alternate_lines;
+    layout.slant = options->slant;
+    if (options->line_width > 0) {
+        layout.max_width = options->line_width;
+    }
+    layout.slant_room = slant_room;
+    layout.page_height = options->page_height;
+    layout.new_page = TurnPage;
+    if (options->order_strokes && options->page_height > 0) {
+        layout.flush_points = 0; // Reorder each page as a whole, not just the lines that happen to share a batch
+    }
+    int result = StreamText(file, &layout);
+    FinishLayout(&layout);
+    FreeStrokes(&job.clipped);
+    result = job.failed ? -1 : result;
+    job.stats.lines = layout.lines.hits + layout.lines.misses;
+    job.stats.copied_lines = layout.lines.hits;
+    FinishGCode(&job.emitter);
+    if (record) {
+        EndCachedJob(record, options->cache_dir, key, result == 0, options->cache_bytes);
+    }
+
+    // Whatever the later stages did not use was spent laying out
+    job.stats.layout_seconds = Seconds(start) - job.stats.optimise_seconds - job.stats.emit_seconds;
+    if (options->stats) {
+        PrintStats(&job);
+    }
+    if (options->estimate || options->stats) {
+        PrintEstimate(&job, FinishEstimate(&job.estimator));
+    }
+    return result;
+}
@@ -0,0 +1,78 @@
+#ifndef JOB_H_INCLUDED
+#define JOB_H_INCLUDED
+
+#include <stdio.h>
+#include "font.h"
+#include "stroke.h"
+#include "gcode.h"
+
+//Settings that apply to a whole job, filled in from the command line
+typedef struct {
+    float tolerance;              // Simplification tolerance (mm), 0 for none
+    int stats;                    // Print the size of the job and the time spent in each stage
+    int order_strokes;            // Reorder strokes for less pen-up travel
+    double order_budget;          // Seconds the reordering may take per batch of strokes (per page if paged)
+    int alternate_lines;          // Write every other line right to left
+    float slant;                  // Italics: how far right (mm) the text leans for each mm up, 0 for upright
+    float line_width;             // Wrap lines at this width (mm), 0 for the layout's MAX_WIDTH
+    float fit_width, fit_height;  // Pick the largest height that fits the text in this box (mm), 0 to ask for one
+    float join_distance;          // Strokes starting this close (mm) to the last one's end are drawn without a pen lift,
+                                  // 0 to lift the pen for every stroke
+    int merge_moves;              // Merge straight runs of G1s and repeated G0s before sending
+    float merge_distance;         // Furthest (mm) a merged point may be from the move that replaces it
+    float merge_angle;            // Largest turn (degrees) still counted as going straight on
+    float arc_tolerance;          // Send curved runs as G2/G3 arcs within this distance (mm), 0 for none
+    int compact;                  // Leave unchanged G words, axes and trailing zeros out of the G-code
+    int fold_pen;                 // Put pen changes on the line of the next move
+    int relative;                 // Send moves as G91 distances when shorter
+    int draw_feed;                // Feed rate (mm/min) with the pen down
+    int travel_feed;              // Feed rate (mm/min) with the pen up, 0 for the draw feed
+    float pen_dwell;              // Seconds to wait after each pen change
+    int estimate;                 // Print how long the job will take, the G-code goes nowhere
+    float acceleration;           // Robot's acceleration (mm/s^2), for the estimate
+    long baud;                    // Serial link speed, for the estimate
+    double send_seconds;          // Wait after sending each command, for the estimate
+    const char *cache_dir;        // Keep compiled jobs here and send repeats from it, NULL for no cache
+    long long cache_bytes;        // Most the cache may hold before the least recently used jobs go
+    int check_workspace;          // Make sure everything drawn lies in the workspace
+    Box workspace;                // What the robot can reach (mm)
+    int clip_workspace;           // Cut strokes off at the edge of the workspace instead of refusing the job
+    float page_height;            // Start a new page once the lines would go past this (mm), 0 for one page
+    int first_page, last_page;    // Only send these pages (from 1), to pick a job up again or share it out; 0 for all
+    const char *page_gcode;       // Sent between pages once the pen is home, e.g. to feed the paper, NULL for none
+    void (*change_paper)(int page); // Waits between pages while the paper is changed, NULL to carry straight on
+} JobOptions;
+
+//Time spent in each stage of the pipeline, so each one can be measured on its own
+typedef struct {
+    double layout_seconds;        // Reading the text and laying out strokes
+    double optimise_seconds;      // Reordering strokes
+    double emit_seconds;          // Turning strokes into G-code and sending it
+    double travel_before;         // Pen-up travel (mm) in text order
+    double travel_after;          // Pen-up travel (mm) after the passes
+    long joins;                   // Pen lifts saved by joining strokes
+    long strokes, points;         // Strokes and points that went through the pipeline
+    long lines, copied_lines;     // Lines laid out, and how many of those were copied from the same line earlier
+    long clipped;                 // Strokes cut at the edge of the workspace
+    long pages;                   // Pages sent
+} JobStats;
+
+//One job on its way through the pipeline: text -> layout -> stroke list -> passes -> emitter
+typedef struct {
+    const JobOptions *options;
+    GCodeEmitter emitter;
+    Estimator estimator;          // Only used for --estimate and --stats
+    Box workspace;                // Where the strokes must be, allowing for arcs bulging out
+    StrokeList clipped;           // Where ClipStrokes() builds the clipped strokes
+    int page;                     // Page the layout is on, from 0
+    int sent_page;                // Page the last strokes sent were on, -1 before any
+    int failed;                   // A pass ran out of memory, nothing more is sent
+    JobStats stats;
+} Job;
+
+int WriteText(FILE *file, const Font *font, float height, const JobOptions *options,
+              char *buffer, void (*send)(char *buffer));   // Lay out a text file and send it as G-code
+float FitTextHeight(FILE *file, const Font *font, const JobOptions *options, float min_height,
+                    float max_height);                      // Height for the --fit box, 0 if it does not fit
+
+#endif // JOB_H_INCLUDED
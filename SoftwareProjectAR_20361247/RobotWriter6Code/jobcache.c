@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "jobcache.h"
+#include "layout.h"
+
+#if !defined(__linux__)
+#include <direct.h>
+#endif
+
+#define FNV_OFFSET 14695981039346656037ULL // 64-bit FNV-1a
+#define FNV_PRIME 1099511628211ULL
+#define JOB_CACHE_HEADER "GCODECACHE %016llx %12ld %016llx\n" // Key, bytes after the header and their hash, same
+#define JOB_CACHE_HEADER_SIZE 58                                 // length every time
+#define JOB_CACHE_PATH_SIZE (FONT_FILE_SIZE + 32)
+
+static unsigned long long HashBytes(unsigned long long hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static unsigned long long HashInt(unsigned long long hash, long long value) {
+    return HashBytes(hash, &value, sizeof(value));
+}
+
+// Floats go in as their bits, any change to a setting makes a new key
+static unsigned long long HashFloat(unsigned long long hash, double value) {
+    return HashBytes(hash, &value, sizeof(value));
+}
+
+// A run of spaces and newlines goes in as its newlines, or as one space if it has none
+static unsigned long long HashGap(unsigned long long hash, int newlines) {
+    if (newlines == 0) {
+        return HashBytes(hash, " ", 1);
+    }
+    for (int n = 0; n < newlines; n++) {
+        hash = HashBytes(hash, "\n", 1);
+    }
+    return hash;
+}
+
+// Hashes the text the way StreamText() reads it: a run of spaces and newlines only matters for how many newlines
+// it has.
+static unsigned long long HashText(unsigned long long hash, FILE *text) {
+    char chunk[TEXT_CHUNK_SIZE];
+    int in_gap = 0, newlines = 0;
+    size_t count;
+
+    while ((count = fread(chunk, sizeof(char), sizeof(chunk), text)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            char c = chunk[i];
+            if (c == ' ' || c == '\n') {
+                in_gap = 1;
+                newlines += c == '\n';
+                continue;
+            }
+            if (in_gap) {
+                hash = HashGap(hash, newlines);
+                in_gap = 0;
+                newlines = 0;
+            }
+            hash = HashBytes(hash, &c, 1);
+        }
+    }
+    if (in_gap) {
+        hash = HashGap(hash, newlines);
+    }
+    return hash;
+}
+
+//The key for a job: the text, the height, the font and every option that changes the G-code. The font is known by
+//the bytes of the snapshot the job draws from, so a file edited within the same second still makes a new key.
+unsigned long long JobKey(FILE *text, const Font *font, float height, const JobOptions *options) {
+    unsigned long long hash = FNV_OFFSET;
+    hash = HashInt(hash, JOB_CACHE_VERSION);
+    hash = HashText(hash, text);
+    rewind(text);
+    hash = HashFloat(hash, height);
+
+    hash = HashInt(hash, font->data_size);
+    hash = HashBytes(hash, font->data, (size_t)font->data_size);
+    hash = HashInt(hash, font->options);
+
+    hash = HashFloat(hash, options->tolerance);
+    hash = HashInt(hash, options->order_strokes);
+    hash = HashFloat(hash, options->order_budget);
+    hash = HashInt(hash, options->alternate_lines);
+    hash = HashFloat(hash, options->slant);
+    hash = HashFloat(hash, options->line_width);
+    hash = HashFloat(hash, options->page_height);
+    hash = HashInt(hash, options->first_page);
+    hash = HashInt(hash, options->last_page);
+    if (options->page_gcode) {
+        hash = HashBytes(hash, options->page_gcode, strlen(options->page_gcode) + 1);
+    }
+    hash = HashFloat(hash, options->join_distance);
+    hash = HashInt(hash, options->merge_moves);
+    hash = HashFloat(hash, options->merge_distance);
+    hash = HashFloat(hash, options->merge_angle);
+    hash = HashFloat(hash, options->arc_tolerance);
+    hash = HashInt(hash, options->compact);
+    hash = HashInt(hash, options->fold_pen);
+    hash = HashInt(hash, options->relative);
+    hash = HashInt(hash, options->draw_feed);
+    hash = HashInt(hash, options->travel_feed);
+    hash = HashFloat(hash, options->pen_dwell);
+    hash = HashInt(hash, options->check_workspace);
+    hash = HashFloat(hash, options->workspace.min_x);
+    hash = HashFloat(hash, options->workspace.min_y);
+    hash = HashFloat(hash, options->workspace.max_x);
+    hash = HashFloat(hash, options->workspace.max_y);
+    hash = HashInt(hash, options->clip_workspace);
+    return hash;
+}
+
+static void CachePath(char *path, const char *dir, unsigned long long key, const char *suffix) {
+    snprintf(path, JOB_CACHE_PATH_SIZE, "%s/%016llx%s", dir, key, suffix);
+}
+
+// Reads through the commands after the header: each was stored with a '\0' after it. Returns the hash of the bytes,
+// or sets *whole to 0 if a command is longer than any the emitter writes or the last one has no '\0'.
+static unsigned long long CheckCommands(FILE *file, int *whole) {
+    unsigned long long hash = FNV_OFFSET;
+    int length = 0, c;
+    *whole = 1;
+    while ((c = getc(file)) != EOF) {
+        unsigned char byte = (unsigned char)c;
+        hash = HashBytes(hash, &byte, 1);
+        length = c == '\0' ? 0 : length + 1;
+        if (length == GCODE_BUFFER_SIZE) {
+            *whole = 0;
+        }
+    }
+    *whole = *whole && length == 0 && !ferror(file);
+    return hash;
+}
+
+//Sends a cached job one command at a time, the same commands the emitter sent when it was recorded. The file is
+//read through once first, and nothing is sent unless it has the size and hash its header says and every command
+//in it is whole. Returns -1 if the job is not in the cache or the file is damaged.
+int SendCachedJob(const char *dir, unsigned long long key, char *buffer, void (*send)(char *buffer),
+                  long *lines, long *bytes) {
+    char path[JOB_CACHE_PATH_SIZE];
+    CachePath(path, dir, key, JOB_CACHE_SUFFIX);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    unsigned long long stored_key, stored_hash;
+    long size;
+    int whole = 0;
+    if (fscanf(file, "GCODECACHE %llx %ld %llx", &stored_key, &size, &stored_hash) != 3 || stored_key != key ||
+        fseek(file, JOB_CACHE_HEADER_SIZE, SEEK_SET) != 0 || CheckCommands(file, &whole) != stored_hash || !whole ||
+        ftell(file) != JOB_CACHE_HEADER_SIZE + size || fseek(file, JOB_CACHE_HEADER_SIZE, SEEK_SET) != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    int length = 0, c;
+    *lines = *bytes = 0;
+    while ((c = getc(file)) != EOF) {
+        if (c != '\0') {
+            buffer[length++] = (char)c;
+            *lines += c == '\n';
+            continue;
+        }
+        buffer[length] = '\0';
+        send(buffer);
+        *bytes += length;
+        length = 0;
+    }
+    fclose(file);
+    utime(path, NULL); // Just used, so the last to be evicted
+    return 0;
+}
+
+//Starts recording a job for the cache under a temporary name, so a job that fails part way never gets found.
+//Returns NULL if the directory cannot be written to; the job just goes uncached.
+FILE *BeginCachedJob(const char *dir, unsigned long long key) {
+    char path[JOB_CACHE_PATH_SIZE];
+#if defined(__linux__)
+    mkdir(dir, 0777);
+#else
+    _mkdir(dir);
+#endif
+    CachePath(path, dir, key, ".tmp");
+    FILE *file = fopen(path, "w+b"); // Read back at the end for the hash
+    if (!file) {
+        return NULL;
+    }
+    fprintf(file, JOB_CACHE_HEADER, key, 0L, 0ULL); // Filled in once the size and hash are known
+    return file;
+}
+
+typedef struct {
+    char name[JOB_CACHE_PATH_SIZE];
+    long long size;
+    long long mtime;
+} CacheEntry;
+
+static int CompareAge(const void *a, const void *b) {
+    const CacheEntry *first = a, *second = b;
+    return (first->mtime > second->mtime) - (first->mtime < second->mtime);
+}
+
+// Removes the least recently used jobs until the cache holds no more than max_bytes
+static void EvictJobs(const char *dir, long long max_bytes) {
+    DIR *folder = opendir(dir);
+    if (!folder) {
+        return;
+    }
+    CacheEntry *entries = NULL;
+    int count = 0, capacity = 0;
+    long long total = 0;
+    struct dirent *item;
+    while ((item = readdir(folder)) != NULL) {
+        size_t length = strlen(item->d_name);
+        size_t suffix = strlen(JOB_CACHE_SUFFIX);
+        if (length <= suffix || strcmp(item->d_name + length - suffix, JOB_CACHE_SUFFIX) != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            CacheEntry *grown = realloc(entries, capacity * sizeof(CacheEntry));
+            if (!grown) {
+                break;
+            }
+            entries = grown;
+        }
+        struct stat info;
+        snprintf(entries[count].name, JOB_CACHE_PATH_SIZE, "%s/%s", dir, item->d_name);
+        if (stat(entries[count].name, &info) == 0) {
+            entries[count].size = (long long)info.st_size;
+            entries[count].mtime = (long long)info.st_mtime;
+            total += entries[count].size;
+            count++;
+        }
+    }
+    closedir(folder);
+
+    qsort(entries, count, sizeof(CacheEntry), CompareAge);
+    for (int i = 0; i < count && total > max_bytes; i++) {
+        if (remove(entries[i].name) == 0) {
+            total -= entries[i].size;
+        }
+    }
+    free(entries);
+}
+
+//Finishes recording. A job that was sent in full is kept under its key, with the size and hash of its commands in the
+//header, and the least recently used jobs are evicted to bring the cache back under max_bytes. Otherwise the
+//recording is thrown away.
+void EndCachedJob(FILE *file, const char *dir, unsigned long long key, int keep, long long max_bytes) {
+    char path[JOB_CACHE_PATH_SIZE], temp_path[JOB_CACHE_PATH_SIZE];
+    CachePath(path, dir, key, JOB_CACHE_SUFFIX);
+    CachePath(temp_path, dir, key, ".tmp");
+
+    long size = ftell(file) - JOB_CACHE_HEADER_SIZE;
+    int whole = 0;
+    unsigned long long hash = 0;
+    if (keep && size >= 0 && fseek(file, JOB_CACHE_HEADER_SIZE, SEEK_SET) == 0) {
+        hash = CheckCommands(file, &whole);
+    }
+    keep = keep && whole;
+    if (keep && fseek(file, 0, SEEK_SET) == 0) {
+        fprintf(file, JOB_CACHE_HEADER, key, size, hash);
+    }
+    keep = keep && !ferror(file);
+    if (fclose(file) != 0 || !keep) {
+        remove(temp_path);
+        return;
+    }
+    remove(path); // rename() does not replace an existing file on Windows
+    rename(temp_path, path);
+    EvictJobs(dir, max_bytes);
+}
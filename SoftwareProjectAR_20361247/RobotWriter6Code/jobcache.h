@@ -0,0 +1,19 @@
+#ifndef JOBCACHE_H_INCLUDED
+#define JOBCACHE_H_INCLUDED
+
+#include <stdio.h>
+#include "font.h"
+#include "job.h"
+
+#define JOB_CACHE_VERSION 2       // Part of every key: change it when the G-code for the same job changes
+#define JOB_CACHE_SUFFIX ".gcode" // A compiled job is kept as <key in hex>.gcode in the cache directory
+
+//Compiled jobs on disk, found by a hash of everything that decides their G-code, so a job that was written before
+//is sent straight from the file without laying anything out. The least recently used go when it gets too big.
+unsigned long long JobKey(FILE *text, const Font *font, float height, const JobOptions *options); // Reads the text, then rewinds it
+int SendCachedJob(const char *dir, unsigned long long key, char *buffer, void (*send)(char *buffer),
+                  long *lines, long *bytes);                        // 0 if the job was there and has been sent
+FILE *BeginCachedJob(const char *dir, unsigned long long key);      // Somewhere to record a job's G-code, NULL if not
+void EndCachedJob(FILE *file, const char *dir, unsigned long long key, int keep, long long max_bytes); // Keep it or not
+
+#endif // JOBCACHE_H_INCLUDED
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+#include "transform.h"
+
+//Sets up the layout at the top left of the page
+void StartLayout(Layout *layout, const Font *font, float height, float tolerance, StrokeHandler flush, void *context) {
+    layout->font = font;
+    layout->height = height;
+    layout->scale = height / FONT_UNITS_HIGH;
+    layout->tolerance = tolerance;
+    layout->x_offset = 0;
+    layout->y_offset = 0;
+    layout->alternate_lines = 0;
+    layout->slant = 0;
+    layout->max_width = MAX_WIDTH;
+    layout->slant_room = 0;
+    layout->page_height = 0;
+    layout->page = 0;
+    layout->page_line = 0;
+    layout->flush_points = LAYOUT_FLUSH_POINTS;
+    layout->line_first = 0;
+    layout->reverse_line = 0;
+    layout->line_text = NULL;
+    layout->line_length = layout->line_size = 0;
+    layout->line_x = 0;
+    layout->line_gaps = 0;
+    InitLineCache(&layout->lines);
+    InitStrokes(&layout->strokes);
+    layout->flush = flush;
+    layout->new_page = NULL;
+    layout->context = context;
+}
+
+//Hands the strokes laid out so far on to the next stage
+static void FlushStrokes(Layout *layout) {
+    if (layout->strokes.num_strokes > 0) {
+        layout->flush(&layout->strokes, layout->context);
+    }
+    ClearStrokes(&layout->strokes);
+    layout->line_first = 0;
+}
+
+//Adds one character's strokes to a stroke list, scaled, slanted and moved to where the character goes. All of
+//its points are moved in one batch, straight into the list.
+static void LayoutGlyph(StrokeList *list, const FontData *glyph, float x_offset, float y_offset, float scale,
+                        float shear) {
+    if (glyph->num_strokes == 0 || ReserveStrokes(list, glyph->num_strokes, glyph->num_points) != 0) {
+        return;
+    }
+    TransformPoints(glyph->point_x, glyph->point_y, glyph->num_points, x_offset, y_offset, scale, shear,
+                    &list->points[list->num_points]);
+    for (int i = 0; i < glyph->num_strokes; i++) {
+        list->strokes[list->num_strokes + i].first = list->num_points + glyph->stroke_first[i];
+        list->strokes[list->num_strokes + i].count = glyph->stroke_count[i];
+    }
+    list->num_strokes += glyph->num_strokes;
+    list->num_points += glyph->num_points;
+}
+
+//Lays out the words of the current line into list with the top of the line at y. The x positions add up in the
+//same order as when the words were placed, so they come out exactly the same.
+static void LayoutLine(Layout *layout, StrokeList *list, float y) {
+    float x = layout->line_x;
+    for (int i = 0; i < layout->line_length; i++) {
+        if (layout->line_text[i] == ' ') {
+            x += layout->scale * WORD_SPACING;
+            continue;
+        }
+        const FontData *glyph = GetSimplifiedGlyph(layout->font, (int)layout->line_text[i], layout->height,
+                                                   layout->tolerance);
+        LayoutGlyph(list, glyph, x, y, layout->scale, layout->slant * layout->scale);
+        x += glyph->advance * layout->scale;
+    }
+}
+
+//Adds the strokes of the current line to the stroke list, copied from the same line earlier on if there was one.
+//A line seen for the second time is laid out at y = 0 and kept. Adding the line's y to those points gives the same
+//floats as laying it out where it is.
+static void PlaceLine(Layout *layout) {
+    if (layout->line_length == 0) {
+        return;
+    }
+    const char *text = layout->line_text;
+    int length = layout->line_length;
+    const StrokeList *line = FindLine(&layout->lines, text, length, layout->line_x);
+    if (!line && SeenLine(&layout->lines, text, length, layout->line_x)) {
+        LayoutLine(layout, LineScratch(&layout->lines), 0);
+        line = KeepLine(&layout->lines, text, length, layout->line_x);
+    }
+    if (line) {
+        AppendStrokes(&layout->strokes, line, layout->y_offset);
+    }
+    else {
+        LayoutLine(layout, &layout->strokes, layout->y_offset);
+    }
+    layout->line_length = 0;
+    layout->line_gaps = 0;
+}
+
+//Called once a line is complete. With alternate lines, a line after one drawn left to right is turned round so it
+//is drawn from its last character back to its first, each character's strokes in reverse too, and the pen finishes
+//near the left margin ready for the next line. Blank lines do not count, the pen has not moved for them.
+static void EndLine(Layout *layout) {
+    PlaceLine(layout);
+    if (layout->strokes.num_strokes == layout->line_first) {
+        return;
+    }
+    if (layout->alternate_lines) {
+        if (layout->reverse_line) {
+            ReverseStrokes(&layout->strokes, layout->line_first);
+        }
+        layout->reverse_line = !layout->reverse_line;
+    }
+    layout->line_first = layout->strokes.num_strokes;
+}
+
+//Starts the next page at the top. The page before goes on as a batch of its own, and the first line is drawn left
+//to right again, so a page comes out the same whatever pages came before it.
+static void NewPage(Layout *layout) {
+    FlushStrokes(layout);
+    layout->page++;
+    layout->page_line = 0;
+    layout->y_offset = 0;
+    layout->reverse_line = 0;
+    if (layout->new_page) {
+        layout->new_page(layout->page, layout->context);
+    }
+}
+
+//Moves to the start of the next line. A line break is where a big enough batch of strokes gets handed on, and
+//where a page ends once the next line would go past the page height (a page always gets at least one line).
+static void NewLine(Layout *layout) {
+    EndLine(layout);
+    layout->y_offset -= layout->height; // Move to the next line
+    layout->x_offset = 0;               // Reset horizontal position
+    layout->page_line++;
+    if (layout->page_height > 0 && (layout->page_line + 1) * layout->height > layout->page_height) {
+        NewPage(layout);
+        return;
+    }
+    if (layout->flush_points > 0 && layout->strokes.num_points >= layout->flush_points) {
+        FlushStrokes(layout);
+    }
+}
+
+//Places one word on the line, moving to the next line first if it would not fit within the line width. A word
+//longer than MAX_WORD_LENGTH is placed in pieces of that size, the way StreamText() hands them over.
+//Returns -1 if the word has a character the font cannot draw.
+int LayoutWord(Layout *layout, const char *word, int length) {
+    if (length > MAX_WORD_LENGTH) {
+        if (LayoutWord(layout, word, MAX_WORD_LENGTH) != 0) {
+            return -1;
+        }
+        return LayoutWord(layout, word + MAX_WORD_LENGTH, length - MAX_WORD_LENGTH);
+    }
+
+    // This calculates word width, keeping each character's width to move along by
+    float advances[MAX_WORD_LENGTH];
+    float word_width = 0;
+    for (int i = 0; i < length; i++) {
+        const FontData *glyph = GetSimplifiedGlyph(layout->font, (int)word[i], layout->height, layout->tolerance);
+        if (!glyph) {
+            // Error handling for invalid or undefined character
+            fprintf(stderr, "Error: Invalid or undefined character '%c' (ASCII: %d) encountered.\n", word[i], (int)word[i]);
+            return -1;
+        }
+        advances[i] = glyph->advance * layout->scale;
+        word_width += advances[i];
+    }
+
+    // Checks if the word fits in the remaining width
+    if (layout->x_offset + word_width > layout->max_width - layout->slant_room) {
+        NewLine(layout);
+    }
+
+    if (length == 0) {
+        return 0;
+    }
+
+    // Place the word on the line, it is laid out with the rest of the line once the line is complete
+    int gaps = layout->line_length > 0 ? layout->line_gaps : 0; // Gaps before the first word only move where it starts
+    if (layout->line_length + gaps + length > layout->line_size) {
+        int size = 2 * (layout->line_length + gaps + length);
+        char *text = realloc(layout->line_text, size);
+        if (!text) {
+            perror("Error allocating line");
+            return -1;
+        }
+        layout->line_text = text;
+        layout->line_size = size;
+    }
+    if (layout->line_length == 0) {
+        layout->line_x = layout->x_offset;
+    }
+    memset(layout->line_text + layout->line_length, ' ', gaps);
+    layout->line_length += gaps;
+    layout->line_gaps = 0;
+    for (int i = 0; i < length; i++) {
+        layout->line_text[layout->line_length++] = word[i];
+
+        // Update the x-offset for the next character
+        layout->x_offset += advances[i];
+    }
+    return 0;
+}
+
+//Handles the run of spaces and newlines that follows a word
+void LayoutGap(Layout *layout, int newlines) {
+    for (int i = 0; i < newlines; i++) {
+        NewLine(layout);
+    }
+    layout->x_offset += layout->scale * WORD_SPACING; // Add spacing between words
+    layout->line_gaps++;
+}
+
+//Hands on the last strokes and frees the stroke list and the lines kept for copying
+void FinishLayout(Layout *layout) {
+    EndLine(layout);
+    FlushStrokes(layout);
+    FreeStrokes(&layout->strokes);
+    free(layout->line_text);
+    FreeLineCache(&layout->lines);
+}
+
+//Reads the text a chunk at a time and hands each word to the layout as soon as the spaces and newlines after it
+//are known. Only one chunk and one word are ever held, so the length of the text does not matter.
+//Returns -1 if the text has a character the font cannot draw.
+int StreamText(FILE *file, Layout *layout) {
+    char chunk[TEXT_CHUNK_SIZE];
+    char word[MAX_WORD_LENGTH];
+    int length = 0;        // Characters of the current word so far
+    int in_gap = 0;        // Whether we are in the spaces and newlines after the word
+    int newlines = 0;      // Newlines in that gap
+    size_t count;
+
+    while ((count = fread(chunk, sizeof(char), sizeof(chunk), file)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            char c = chunk[i];
+            if (c == ' ' || c == '\n') {
+                in_gap = 1;
+                newlines += c == '\n';
+                continue;
+            }
+
+            // The first character after a gap: the word before it and its gap are complete
+            if (in_gap) {
+                if (LayoutWord(layout, word, length) != 0) {
+                    return -1;
+                }
+                LayoutGap(layout, newlines);
+                length = 0;
+                in_gap = 0;
+                newlines = 0;
+            }
+
+            // A word too long to hold is laid out in pieces (it would never fit on one line anyway)
+            if (length == MAX_WORD_LENGTH) {
+                if (LayoutWord(layout, word, length) != 0) {
+                    return -1;
+                }
+                length = 0;
+            }
+            word[length++] = c;
+        }
+    }
+
+    // Whatever is left at the end of the file
+    if (length > 0 || in_gap) {
+        if (LayoutWord(layout, word, length) != 0) {
+            return -1;
+        }
+        LayoutGap(layout, newlines);
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef LAYOUT_H_INCLUDED
+#define LAYOUT_H_INCLUDED
+
+#include <stdio.h>
+#include "font.h"
+#include "stroke.h"
+#include "linecache.h"
+
+//Defining the limits for the text input
+#define TEXT_CHUNK_SIZE 512       // Bytes read from the text file at a time
+#define MAX_WORD_LENGTH 128       // Longer words are laid out in pieces of this size
+
+#define MAX_WIDTH 100.0f          // Width of writing area (mm) unless the job gives its own
+#define WORD_SPACING 4            // Gap between words in font units
+#define LAYOUT_FLUSH_POINTS 4096  // Default for flush_points
+
+//Called with each batch of laid out strokes, in page order. The list is emptied afterwards.
+typedef void (*StrokeHandler)(StrokeList *strokes, void *context);
+
+//Called when the layout moves on to a new page (numbered from 0), after the last batch of the page before
+typedef void (*PageHandler)(int page, void *context);
+
+//Where the layout has got to. Words are placed one at a time as they are read, a line's strokes are laid out once
+//the line is complete (or copied from the same line earlier on) and handed on a batch of whole lines at a time, or
+//a whole page at a time.
+typedef struct {
+    const Font *font;
+    float height;                 // Text height (mm)
+    float scale;                  // Scale factor for font height
+    float tolerance;              // Simplification tolerance (mm), 0 for none
+    float x_offset, y_offset;     // Where the next character starts
+    int alternate_lines;          // Draw every other line right to left, so the pen does not go back to the margin
+    float slant;                  // How far right a point moves for each mm up (italics), 0 for upright
+    float max_width;              // Lines wrap before a word that would go past this (mm), MAX_WIDTH unless set
+    float slant_room;             // Kept free at the end of each line (mm) for slanted characters to lean into
+    float page_height;            // A page takes as many lines as fit in this (mm), 0 for one page however long
+    int page;                     // Page being laid out, from 0
+    int page_line;                // Line of the page being laid out, from 0
+    int flush_points;             // Hand the strokes on at a line break once there are this many points, 0 to keep
+                                  // them until the end of the page
+    int line_first;               // First stroke of the current line
+    int reverse_line;             // Whether the current line is drawn right to left
+    char *line_text;              // Words placed on the current line, a space for each gap between them
+    int line_length, line_size;
+    float line_x;                 // Where the current line's first word starts
+    int line_gaps;                // Gaps since the last word on the current line
+    LineCache lines;              // Lines laid out so far, to copy when the same one comes round again
+    StrokeList strokes;           // Laid out but not yet handed on
+    StrokeHandler flush;
+    PageHandler new_page;         // NULL if nothing needs to know
+    void *context;                // Passed to flush and new_page
+} Layout;
+
+void StartLayout(Layout *layout, const Font *font, float height, float tolerance, StrokeHandler flush, void *context);
+int LayoutWord(Layout *layout, const char *word, int length);   // Wrap if needed, then place the word on the line
+void LayoutGap(Layout *layout, int newlines);                   // The spaces and newlines after a word
+void FinishLayout(Layout *layout);                              // Hand on whatever strokes are left
+int StreamText(FILE *file, Layout *layout);                     // Read the text in chunks and lay it out word by word
+
+#endif // LAYOUT_H_INCLUDED
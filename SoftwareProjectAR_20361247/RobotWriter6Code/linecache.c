@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linecache.h"
+
+#define FNV_OFFSET 14695981039346656037ULL // 64-bit FNV-1a
+#define FNV_PRIME 1099511628211ULL
+
+void InitLineCache(LineCache *cache) {
+    for (int i = 0; i < LINE_CACHE_BUCKETS; i++) {
+        cache->buckets[i] = NULL;
+    }
+    for (int i = 0; i < LINE_CACHE_SEEN; i++) {
+        cache->seen[i] = 0;
+    }
+    cache->points = 0;
+    InitStrokes(&cache->scratch);
+    cache->hits = cache->misses = 0;
+}
+
+void FreeLineCache(LineCache *cache) {
+    for (int i = 0; i < LINE_CACHE_BUCKETS; i++) {
+        LineTemplate *line = cache->buckets[i];
+        while (line) {
+            LineTemplate *next = line->next;
+            free(line->text);
+            FreeStrokes(&line->strokes);
+            free(line);
+            line = next;
+        }
+        cache->buckets[i] = NULL;
+    }
+    cache->points = 0;
+    FreeStrokes(&cache->scratch);
+}
+
+static unsigned long long HashLine(const char *text, int length, float start_x) {
+    unsigned long long hash = FNV_OFFSET;
+    const unsigned char *bytes = (const unsigned char *)&start_x;
+    for (size_t i = 0; i < sizeof(start_x); i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+//The strokes of a line with these words starting at start_x, if one has been kept, laid out with its top at y = 0
+const StrokeList *FindLine(LineCache *cache, const char *text, int length, float start_x) {
+    unsigned long long hash = HashLine(text, length, start_x);
+    for (LineTemplate *line = cache->buckets[hash % LINE_CACHE_BUCKETS]; line; line = line->next) {
+        if (line->hash == hash && line->length == length && line->start_x == start_x &&
+            memcmp(line->text, text, length) == 0) {
+            cache->hits++;
+            return &line->strokes;
+        }
+    }
+    cache->misses++;
+    return NULL;
+}
+
+//Whether a line that was not found has been seen before, remembering it for next time. Most lines of a text are
+//never repeated, keeping those would only cost time. A line seen long ago can have been forgotten.
+int SeenLine(LineCache *cache, const char *text, int length, float start_x) {
+    unsigned long long hash = HashLine(text, length, start_x);
+    unsigned long long *slot = &cache->seen[hash % LINE_CACHE_SEEN];
+    if (*slot == hash) {
+        return 1;
+    }
+    *slot = hash;
+    return 0;
+}
+
+StrokeList *LineScratch(LineCache *cache) {
+    ClearStrokes(&cache->scratch);
+    return &cache->scratch;
+}
+
+//Keeps a copy of the line just laid out in the scratch list, unless the cache is full. Returns the strokes to use
+//for it either way.
+const StrokeList *KeepLine(LineCache *cache, const char *text, int length, float start_x) {
+    const StrokeList *scratch = &cache->scratch;
+    if (cache->points + scratch->num_points > LINE_CACHE_POINTS) {
+        return scratch;
+    }
+    LineTemplate *line = malloc(sizeof(LineTemplate));
+    char *copy = malloc(length > 0 ? length : 1);
+    Stroke *strokes = malloc((scratch->num_strokes > 0 ? scratch->num_strokes : 1) * sizeof(Stroke));
+    StrokePoint *points = malloc((scratch->num_points > 0 ? scratch->num_points : 1) * sizeof(StrokePoint));
+    if (!line || !copy || !strokes || !points) {
+        free(line);
+        free(copy);
+        free(strokes);
+        free(points);
+        return scratch; // Only a copy that would have saved time later
+    }
+
+    memcpy(copy, text, length);
+    memcpy(strokes, scratch->strokes, scratch->num_strokes * sizeof(Stroke));
+    memcpy(points, scratch->points, scratch->num_points * sizeof(StrokePoint));
+    line->text = copy;
+    line->length = length;
+    line->start_x = start_x;
+    line->hash = HashLine(text, length, start_x);
+    line->strokes.strokes = strokes;
+    line->strokes.num_strokes = line->strokes.max_strokes = scratch->num_strokes;
+    line->strokes.points = points;
+    line->strokes.num_points = line->strokes.max_points = scratch->num_points;
+
+    LineTemplate **bucket = &cache->buckets[line->hash % LINE_CACHE_BUCKETS];
+    line->next = *bucket;
+    *bucket = line;
+    cache->points += scratch->num_points;
+    return &line->strokes;
+}
@@ -0,0 +1,37 @@
+#ifndef LINECACHE_H_INCLUDED
+#define LINECACHE_H_INCLUDED
+
+#include "stroke.h"
+
+#define LINE_CACHE_BUCKETS 1024   // Hash table size
+#define LINE_CACHE_SEEN 8192      // Lines remembered as seen once, a line is only kept when it comes round again
+#define LINE_CACHE_POINTS 1048576 // Most points kept in all the lines together, later lines are not kept
+
+//A line laid out at the top of the page. The font, height and tolerance are the layout's, so the words on the line
+//and where the first one starts are all that tell two lines apart.
+typedef struct LineTemplate {
+    char *text;                   // The words, with a space for each gap between them
+    int length;
+    float start_x;                // Where the first word starts
+    unsigned long long hash;
+    StrokeList strokes;           // Laid out with the top of the line at y = 0
+    struct LineTemplate *next;    // Next in the same bucket
+} LineTemplate;
+
+//The lines one layout has seen, so a line that comes round again is copied down the page instead of laid out
+typedef struct {
+    LineTemplate *buckets[LINE_CACHE_BUCKETS];
+    unsigned long long seen[LINE_CACHE_SEEN]; // Hashes of lines seen, each in the slot its hash picks
+    long points;                  // Points held by all the templates
+    StrokeList scratch;           // Where a new line is laid out before it is kept
+    long hits, misses;            // Lines found and lines laid out
+} LineCache;
+
+void InitLineCache(LineCache *cache);
+void FreeLineCache(LineCache *cache);
+const StrokeList *FindLine(LineCache *cache, const char *text, int length, float start_x); // NULL if not seen
+int SeenLine(LineCache *cache, const char *text, int length, float start_x); // Whether it is worth keeping
+StrokeList *LineScratch(LineCache *cache);  // An empty list to lay out a line that was not found
+const StrokeList *KeepLine(LineCache *cache, const char *text, int length, float start_x); // Keep what is in the scratch
+
+#endif // LINECACHE_H_INCLUDED
@@ -2,219 +2,510 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include "rs232.h"
 #include "serial.h"
 
-//Defining the limits for the movements, buffer, and the font data
-#define MAX_FONT_DATA 128
-#define MAX_MOVEMENTS 100
-#define BUFFER_SIZE 100
+#include "font.h"
+#include "job.h"
+#include "simulate.h"
+#include "transform.h"
 
-//Created a structure just to store the data of when the robot should lift the pen and where to move next
-typedef struct {
-    int x;
-    int y;
-    int pen;
-} Movement;
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
-//Created a structure to store the font data details and this also includes the Movement structure 
-typedef struct {
-    int ascii;
-    int num_movements;
-    Movement movements[MAX_MOVEMENTS];
-} FontData;
+//Defining the limits for the buffer
+#define BUFFER_SIZE GCODE_BUFFER_SIZE
 
-// Global variables
-FontData font[MAX_FONT_DATA];
+//Defaults for path simplification (--simplify)
+#define MACHINE_RESOLUTION 0.1f   // Smallest detail (mm) the robot can actually draw
+#define MAX_SIMPLIFY_ERROR 0.1f   // Furthest (mm) a simplified point may move from where the font put it
+
+//Default tolerances for merging moves (--merge-moves): half the 0.01mm the coordinates are printed to, and a degree
+#define MERGE_DISTANCE 0.005f
+#define MERGE_ANGLE 1.0f
+
+//Default time the stroke reordering (--optimise-travel) may take for each batch of strokes
+#define ORDER_BUDGET_MS 100
+
+//How long SendCommands waits after each command, and the acceleration the estimate (--estimate) assumes by default.
+//The acceleration is a guess until it is measured on the robot.
+#define SEND_DELAY_MS 100
+#define DEFAULT_ACCELERATION 500.0f
+
+//Default size limit of the compiled job cache (--cache)
+#define JOB_CACHE_MB 64
+
+//Text heights a job can be written at (mm)
+#define MIN_HEIGHT 4.0f
+#define MAX_HEIGHT 10.0f
+
+//Text height --benchmark moves the characters to, the middle of the 4-10mm range
+#define BENCHMARK_HEIGHT 7.0f
 
 
 // Function declarations
-void LoadFontData(const char *filename);
-void GenerateGCode(char *text, float height, char *buffer);
+int ParseFontOption(const char *option, int font_options);
+int RunJob(const Font *font, const JobOptions *options, char *buffer, void (*send)(char *buffer));
+int AskForAnotherJob(void);
+void ChangePaper(int page);
+int EndSimulation(const char *image_file, float pixels_per_mm, FILE *move_times);
 void SendCommands (char *buffer );
+void DiscardCommands(char *buffer);
+void SimulateCommands(char *buffer);
+
+// Where the G-code goes in place of the robot with --simulate
+static Simulator simulator;
 
 
-int main() 
+int main(int argc, char *argv[]) 
 {
     //Initialising the required variables to run the software
-    char font_file[] = "SingleStrokeFont.txt";
-    char text_file[100];
-    char text[1000];
-    float height;
-    char buffer[100];
-
-    // Loading the font data
-    printf("Loading font data...\n");
-    LoadFontData(font_file);
+    char font_name[FONT_NAME_SIZE] = ""; // Empty until the user picks a font
+    char buffer[BUFFER_SIZE];
+    const char *font_files[MAX_FONTS]; // The --font-file options, loaded once all the options have been read
+    int num_font_files = 0;
+    int font_options = 0;
+    int simplify = 0;
+    float resolution = MACHINE_RESOLUTION, max_error = MAX_SIMPLIFY_ERROR;
+    int resident = 0;
+    int fit_arcs = 0;
+    int benchmark = 0;
+    float arc_tolerance = 0; // 0 until given: the machine resolution, whatever --resolution turns out to be
+    int join_strokes = 0;
+    JobOptions options = {0};
+    options.order_budget = ORDER_BUDGET_MS / 1000.0;
+    options.merge_distance = MERGE_DISTANCE;
+    options.merge_angle = MERGE_ANGLE;
+    options.draw_feed = DEFAULT_FEED;
+    options.acceleration = DEFAULT_ACCELERATION;
+    options.baud = bdrate;
+    options.send_seconds = SEND_DELAY_MS / 1000.0;
+    options.cache_bytes = JOB_CACHE_MB * 1024LL * 1024;
+    const char *image_file = NULL, *times_file = NULL, *gcode_file = NULL;
+    float pixels_per_mm = SIMULATE_PIXELS_PER_MM;
+
+    // Reading the command line options: --font-file NAME=FILE registers a font, --font NAME picks the one for this job
+    // and --optimise-font cleans up and reorders the strokes of every character as it is loaded.
+    // --simplify drops detail finer than the machine resolution (--resolution MM), never moving a point by more than --max-error MM.
+    // --join-strokes draws a stroke that starts within the resolution of where the last one ended without lifting
+    // the pen.
+    // --resident keeps the writer running for more jobs and reloads fonts when their files change.
+    // --stats prints the size of each job and the time spent in each stage.
+    // --optimise-travel reorders the strokes for less pen-up travel, taking at most --travel-budget MS per batch
+    // of lines, or per page with --page-height.
+    // --alternate-lines writes every other line right to left instead of going back to the margin for it.
+    // --merge-moves sends straight runs of moves as one, within --merge-distance MM and --merge-angle DEGREES.
+    // --fit-arcs sends curved runs as G2/G3 arcs that stay within the machine resolution, or --arc-tolerance MM.
+    // --compact leaves out what the robot already has from the line before, --fold-pen also puts S on the move's line.
+    // --relative sends moves as G91 distances where they are shorter than positions, mostly within strokes.
+    // --draw-feed and --travel-feed set the speeds (mm/min) with the pen down and up, --pen-dwell waits SECONDS after
+    // each pen change.
+    // --estimate works out the G-code and how long the robot will take over it at --acceleration MM_PER_S2, but sends
+    // nothing and leaves the COM port alone.
+    // --cache DIR keeps the G-code of each job there, up to --cache-size MB, and sends a repeat of a job from it.
+    // --simulate IMAGE plays the G-code through a model of the robot instead of sending it and draws what the pen
+    // drew, as an SVG or a PNG at --pixels-per-mm. --move-times FILE writes out the timing of every move, and
+    // --gcode FILE simulates a G-code file in place of writing a text file.
+    // --workspace MIN_X,MIN_Y,MAX_X,MAX_Y turns away a job that goes outside what the robot can reach before any of
+    // it is sent, or with --clip cuts the strokes off at the edge.
+    // --italic DEGREES slants the text. --benchmark times moving the characters into place with SIMD against one
+    // point at a time, checks both give the same points, and exits.
+    // --fit WIDTHxHEIGHT wraps the lines at WIDTH mm and writes the text at the largest height that keeps it all in
+    // that box, in place of asking for a height.
+    // --page-height MM splits the text into pages that tall. Between pages the pen goes home and the writer waits for
+    // the paper to be changed, or sends --page-gcode COMMANDS instead. --pages FIRST[-LAST] only writes those pages,
+    // to pick up a job that stopped part way, or to give each robot its own pages of the same job.
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--font-file") == 0 && i + 1 < argc && num_font_files < MAX_FONTS) {
+            font_files[num_font_files++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--font") == 0 && i + 1 < argc) {
+            snprintf(font_name, sizeof(font_name), "%s", argv[++i]);
+        }
+        else if (strcmp(argv[i], "--optimise-font") == 0) {
+            font_options |= FONT_OPTIMISE_STROKES;
+        }
+        else if (strcmp(argv[i], "--simplify") == 0) {
+            simplify = 1;
+        }
+        else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+            resolution = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-error") == 0 && i + 1 < argc) {
+            max_error = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--resident") == 0) {
+            resident = 1;
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            options.stats = 1;
+        }
+        else if (strcmp(argv[i], "--optimise-travel") == 0) {
+            options.order_strokes = 1;
+        }
+        else if (strcmp(argv[i], "--join-strokes") == 0) {
+            join_strokes = 1;
+        }
+        else if (strcmp(argv[i], "--travel-budget") == 0 && i + 1 < argc) {
+            options.order_budget = atof(argv[++i]) / 1000.0;
+        }
+        else if (strcmp(argv[i], "--alternate-lines") == 0) {
+            options.alternate_lines = 1;
+        }
+        else if (strcmp(argv[i], "--merge-moves") == 0) {
+            options.merge_moves = 1;
+        }
+        else if (strcmp(argv[i], "--merge-distance") == 0 && i + 1 < argc) {
+            options.merge_distance = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--merge-angle") == 0 && i + 1 < argc) {
+            options.merge_angle = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fit-arcs") == 0) {
+            fit_arcs = 1;
+        }
+        else if (strcmp(argv[i], "--arc-tolerance") == 0 && i + 1 < argc) {
+            arc_tolerance = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--compact") == 0) {
+            options.compact = 1;
+        }
+        else if (strcmp(argv[i], "--fold-pen") == 0) {
+            options.compact = 1;
+            options.fold_pen = 1;
+        }
+        else if (strcmp(argv[i], "--relative") == 0) {
+            options.relative = 1;
+        }
+        else if (strcmp(argv[i], "--draw-feed") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            options.draw_feed = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--travel-feed") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            options.travel_feed = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pen-dwell") == 0 && i + 1 < argc && atof(argv[i + 1]) >= 0) {
+            options.pen_dwell = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--estimate") == 0) {
+            options.estimate = 1;
+        }
+        else if (strcmp(argv[i], "--acceleration") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0) {
+            options.acceleration = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            options.cache_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc && atof(argv[i + 1]) >= 0) {
+            options.cache_bytes = (long long)(atof(argv[++i]) * 1024 * 1024);
+        }
+        else if (strcmp(argv[i], "--simulate") == 0 && i + 1 < argc) {
+            image_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pixels-per-mm") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0) {
+            pixels_per_mm = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--move-times") == 0 && i + 1 < argc) {
+            times_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--gcode") == 0 && i + 1 < argc) {
+            gcode_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--workspace") == 0 && i + 1 < argc &&
+                 sscanf(argv[i + 1], "%f,%f,%f,%f", &options.workspace.min_x, &options.workspace.min_y,
+                        &options.workspace.max_x, &options.workspace.max_y) == 4) {
+            options.check_workspace = 1;
+            i++;
+        }
+        else if (strcmp(argv[i], "--clip") == 0) {
+            options.clip_workspace = 1;
+        }
+        else if (strcmp(argv[i], "--italic") == 0 && i + 1 < argc && fabs(atof(argv[i + 1])) < 60) {
+            options.slant = (float)tan(atof(argv[++i]) * M_PI / 180);
+        }
+        else if (strcmp(argv[i], "--benchmark") == 0) {
+            benchmark = 1;
+        }
+        else if (strcmp(argv[i], "--fit") == 0 && i + 1 < argc &&
+                 sscanf(argv[i + 1], "%fx%f", &options.fit_width, &options.fit_height) == 2 &&
+                 options.fit_width > 0 && options.fit_height > 0) {
+            options.line_width = options.fit_width;
+            i++;
+        }
+        else if (strcmp(argv[i], "--page-height") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0) {
+            options.page_height = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pages") == 0 && i + 1 < argc &&
+                 sscanf(argv[i + 1], "%d-%d", &options.first_page, &options.last_page) >= 1 &&
+                 options.first_page >= 1 && (options.last_page == 0 || options.last_page >= options.first_page)) {
+            i++;
+        }
+        else if (strcmp(argv[i], "--page-gcode") == 0 && i + 1 < argc && strlen(argv[i + 1]) < BUFFER_SIZE - 1) {
+            options.page_gcode = argv[++i];
+        }
+        else {
+            printf("Usage: %s [--font-file NAME=FILE]... [--font NAME] [--optimise-font]\n"
+                   "          [--simplify] [--resolution MM] [--max-error MM] [--resident] [--stats]\n"
+                   "          [--optimise-travel] [--travel-budget MS] [--alternate-lines] [--join-strokes]\n"
+                   "          [--merge-moves] [--merge-distance MM] [--merge-angle DEGREES]\n"
+                   "          [--fit-arcs] [--arc-tolerance MM] [--compact] [--fold-pen]\n"
+                   "          [--relative] [--draw-feed MM_PER_MIN] [--travel-feed MM_PER_MIN]\n"
+                   "          [--pen-dwell SECONDS] [--estimate] [--acceleration MM_PER_S2]\n"
+                   "          [--cache DIR] [--cache-size MB] [--simulate IMAGE] [--pixels-per-mm N]\n"
+                   "          [--move-times FILE] [--gcode FILE] [--workspace MIN_X,MIN_Y,MAX_X,MAX_Y] [--clip]\n"
+                   "          [--italic DEGREES] [--benchmark] [--fit WIDTHxHEIGHT] [--page-height MM]\n"
+                   "          [--pages FIRST[-LAST]] [--page-gcode COMMANDS]\n", argv[0]);
+            return 1;
+        }
+    }
 
-    // Get the user input for desired height
-    printf("Enter height (4-10mm): ");
-    scanf("%f", &height);
+    // The robot starts and finishes at the origin, so it has to be in the workspace
+    if (options.check_workspace && !(options.workspace.min_x <= 0 && options.workspace.max_x >= 0 &&
+                                     options.workspace.min_y <= 0 && options.workspace.max_y >= 0)) {
+        printf("The workspace must take in the origin (0, 0) the robot starts from.\n");
+        return 1;
+    }
+    if (options.clip_workspace && !options.check_workspace) {
+        printf("--clip needs a --workspace to clip to.\n");
+        return 1;
+    }
+    if ((options.first_page || options.page_gcode) && options.page_height <= 0) {
+        printf("--pages and --page-gcode need a --page-height.\n");
+        return 1;
+    }
+    if (options.fit_width > 0 && options.page_height > 0) {
+        printf("--fit fits the text on one page, it cannot go with --page-height.\n");
+        return 1;
+    }
 
-    //A while loop to repeatedly ask the user to input a height within the range of 4mm-10mm
-    while (height < 4 || height > 10) {
-        printf("Invalid height. Please use values between 4 and 10mm.\n Enter height again (4-10mm):");
-        scanf("%f", &height);
+    // The simulator stands in for the robot if any of its options were given
+    int simulate = image_file || times_file || gcode_file;
+    FILE *move_times = NULL;
+    if (times_file) {
+        move_times = fopen(times_file, "w");
+        if (!move_times) {
+            perror("Error opening move times file");
+            return 1;
+        }
+    }
+    if (gcode_file) {
+        FILE *gcode = fopen(gcode_file, "r");
+        if (!gcode) {
+            perror("Error opening G-code file");
+            return 1;
+        }
+        StartSimulation(&simulator, options.acceleration, options.baud, options.send_seconds);
+        if (move_times) {
+            TraceEstimate(&simulator.estimator, move_times);
+        }
+        int result = SimulateFile(&simulator, gcode);
+        fclose(gcode);
+        return EndSimulation(image_file, pixels_per_mm, move_times) == 0 && result == 0 ? 0 : 1;
     }
 
-    // Get the user input for text file name
-    printf("Enter text file name: ");
-    scanf("%s", text_file);
-    
-    // Reading the text file
-    FILE *file = fopen(text_file, "r");
-    if (!file) {
-        perror("Error opening text file"); //Showing to the user that the text cannot be opened.
+    // Loading the font data (the default font is only loaded when no other font was given)
+    printf("Loading font data...\n");
+    for (int i = 0; i < num_font_files; i++) {
+        if (ParseFontOption(font_files[i], font_options) != 0) {
+            UnloadFonts();
+            return 1;
+        }
+    }
+    if (num_font_files == 0 && RegisterFont(DEFAULT_FONT_NAME, DEFAULT_FONT_FILE, font_options) != 0) {
         return 1;
     }
+    printf("Font data loaded successfully.\n");  // Notify the user that the font data has been loaded
 
-    // Read the text from the file into the buffer
-    fread(text, sizeof(char), 1000, file);  
-    fclose(file);
-
+    // With several fonts loaded and none picked, ask the user which one the job should use
+    if (font_name[0] == '\0') {
+        if (FontCount() == 1) {
+            snprintf(font_name, sizeof(font_name), "%s", FontNameAt(0));
+        }
+        else {
+            printf("Loaded fonts:");
+            for (int i = 0; i < FontCount(); i++) {
+                printf(" %s", FontNameAt(i));
+            }
+            printf("\nEnter font name: ");
+            scanf("%31s", font_name);
+        }
+    }
+    const Font *font = AcquireFont(font_name);
+    if (!font) {
+        printf("Unknown font '%s'.\n", font_name);
+        UnloadFonts();
+        return 1;
+    }
+    ReleaseFont(font);
+
+    if (benchmark) {
+        font = AcquireFont(font_name);
+        int result = BenchmarkTransform(font, BENCHMARK_HEIGHT, options.slant * BENCHMARK_HEIGHT / FONT_UNITS_HIGH);
+        ReleaseFont(font);
+        UnloadFonts();
+        return result == 0 ? 0 : 1;
+    }
 
-    // Check if the RS232 port can be opened
-    if (CanRS232PortBeOpened() == -1) {
+    // Check if the RS232 port can be opened (an estimate or a simulation does not need it)
+    int offline = options.estimate || simulate;
+    if (!offline && CanRS232PortBeOpened() == -1) {
         printf("Unable to open the COM port.\n");
+        UnloadFonts();
         return 1;
     }
 
-    // Send G-code file to Arduino
-    GenerateGCode(text, height, buffer);
-
-    // Close the RS232 port
-    CloseRS232Port();
-    printf("Communication closed.\n");
-
-    return 0;
-}
-
-//The function to load the font data file
-void LoadFontData(const char *filename) {
-    // Open the font data file for reading
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("Error opening font file"); // Display an error if the file cannot be opened
-        exit(1); // Exit the program if the file cannot be found
-    }
-    else {
-        printf("Font data loaded successfully.\n");  // Notify the user that the font data is being loaded
-            char line[100]; // This is to store lines read from the file
-
-        // Using a while loop to read each line of the font file
-        while (fgets(line, sizeof(line), file)) {
-
-            // Check for the marker indicating the start of a character's font data which is '999' for the first interger
-            if (strncmp(line, "999", 3) == 0) {
-                int ascii, num_movements; // Variables to store ASCII value and movement count
-                sscanf(line, "999 %d %d", &ascii, &num_movements);
-                font[ascii].ascii = ascii; // Store the ASCII value
-                font[ascii].num_movements = num_movements; // Store the number of movements
-
-                // Using a for loop to read each movement for the character
-                for (int i = 0; i < num_movements; i++) {
-                    fgets(line, sizeof(line), file);
-                    sscanf(line, "%d %d %d", &font[ascii].movements[i].x, // Parse x-coordinate
-                                            &font[ascii].movements[i].y, // Parse y-coordinate
-                                            &font[ascii].movements[i].pen); // Parse pen state
-                }
+    // Points closer than the machine resolution can go, as long as the error stays within the bound
+    options.tolerance = simplify ? fminf(resolution, max_error) : 0;
+    // Lifting the pen for a move shorter than the resolution draws nothing different, it only wears the servo
+    options.join_distance = join_strokes ? resolution : 0;
+    options.arc_tolerance = fit_arcs ? (arc_tolerance > 0 ? arc_tolerance : resolution) : 0;
+    // Only the robot needs the paper changed, and the page commands are there to do it instead
+    options.change_paper = options.page_height > 0 && !offline && !options.page_gcode ? ChangePaper : NULL;
+
+    // With --resident the writer stays up after a job and asks for the next one. Edits to the font files are
+    // then picked up in the background, so there is no restart and no pause between jobs.
+    if (resident) {
+        StartFontWatcher();
+    }
+    int result;
+    do {
+        // Each job works from the font as it was when the job started, a reload only affects the next job
+        font = AcquireFont(font_name);
+        if (simulate) {
+            StartSimulation(&simulator, options.acceleration, options.baud, options.send_seconds);
+            if (move_times) {
+                TraceEstimate(&simulator.estimator, move_times);
             }
+            result = RunJob(font, &options, buffer, SimulateCommands);
+            result = EndSimulation(image_file, pixels_per_mm, NULL) == 0 ? result : 1;
+        }
+        else {
+            result = RunJob(font, &options, buffer, options.estimate ? DiscardCommands : SendCommands);
         }
+        ReleaseFont(font);
+    } while (resident && AskForAnotherJob());
+    StopFontWatcher();
+    if (move_times) {
+        fclose(move_times);
     }
-    
-
 
+    // Close the RS232 port
+    if (!offline) {
+        CloseRS232Port();
+        printf("Communication closed.\n");
+    }
 
-    fclose(file);
+    UnloadFonts();
+    return result;
 }
 
-//This function adjusts the height and converts the Gcode
-//This function also ensures that the width of the texts being written is within 100mm limit
-void GenerateGCode(char *text, float height, char *buffer) {
-
-    float x_offset = 0, y_offset = 0; //Initialising the x and y offset variables
-    float max_width = 100.0;       // Maximum width of writing area
-    int previous_pen_state = -1;   // Track previous pen state (-1 = uninitialized)
-
-    float scale = height / 18.0;    // Scale factor for font height
-    sprintf(buffer, "F1000\nM3\n"); // Initialize G-code
-    SendCommands(buffer);
-
-    for (const char *word_start = text; *word_start; ) {
-        // This calculates word width
-        float word_width = 0;
-        const char *p = word_start;
-        while (*p && *p != ' ' && *p != '\n') {
-            int ascii = (int)*p;
-            if (ascii >= 0 && ascii < MAX_FONT_DATA && font[ascii].num_movements > 0) {
-                word_width += font[ascii].movements[font[ascii].num_movements - 1].x * scale;
-            }
-            else {
-                // Error handling for invalid or undefined character
-                fprintf(stderr, "Error: Invalid or undefined character '%c' (ASCII: %d) encountered.\n", *p, ascii);
-                return 0;
-            }
-            p++;
-        }
+//Asks the user for the height and the text file, then writes the text out with the given font.
+//With --fit the height is worked out from the text instead of asked for.
+int RunJob(const Font *font, const JobOptions *options, char *buffer, void (*send)(char *buffer)) {
+    char text_file[100];
+    float height = 0;
 
-        // Checks if the word fits in the remaining width
-        if (x_offset + word_width > max_width) {
-            y_offset -= height; // Move to the next line
-            x_offset = 0;      // Reset horizontal position
-        }
+    if (options->fit_width <= 0) {
+        // Get the user input for desired height
+        printf("Enter height (4-10mm): ");
+        scanf("%f", &height);
 
-        // A for loop to drawing the word
-        for (; *word_start && *word_start != ' ' && *word_start != '\n'; word_start++) {
-            int ascii = (int)*word_start;
+        //A while loop to repeatedly ask the user to input a height within the range of 4mm-10mm
+        while (height < MIN_HEIGHT || height > MAX_HEIGHT) {
+            printf("Invalid height. Please use values between 4 and 10mm.\n Enter height again (4-10mm):");
+            scanf("%f", &height);
+        }
+    }
 
-            // Skip undefined characters that is not found within the font data file
-            if (ascii < 0 || ascii >= MAX_FONT_DATA || font[ascii].num_movements == 0) {
-                continue;
-            }
+    // Get the user input for text file name
+    printf("Enter text file name: ");
+    scanf("%s", text_file);
+    
+    // Reading the text file
+    FILE *file = fopen(text_file, "r");
+    if (!file) {
+        perror("Error opening text file"); //Showing to the user that the text cannot be opened.
+        return 1;
+    }
 
-            for (int j = 0; j < font[ascii].num_movements; j++) {
-                Movement move = font[ascii].movements[j];
-                float x = x_offset + move.x * scale;
-                float y = y_offset + move.y * scale;
-                
-                // Only write S0 or S1000 if the pen state changes
-                if (move.pen != previous_pen_state) {
-                    sprintf(buffer, move.pen == 1 ? "S1000\n" : "S0\n");
-                    SendCommands(buffer);
-                    previous_pen_state = move.pen; // Update previous pen state
-                }
-
-                sprintf(buffer, move.pen == 1 ? "G1 X%.2f Y%.2f\n" : "G0 X%.2f Y%.2f\n", x, y);
-                SendCommands(buffer);
-            }
-            // Update the x-offset for the next character
-            x_offset += font[ascii].movements[font[ascii].num_movements - 1].x * scale;
+    if (options->fit_width > 0) {
+        clock_t start = clock();
+        height = FitTextHeight(file, font, options, MIN_HEIGHT, MAX_HEIGHT);
+        if (height == 0) {
+            printf("The text does not fit in %.1f x %.1f mm, even at %.0fmm high.\n", options->fit_width,
+                   options->fit_height, MIN_HEIGHT);
+            fclose(file);
+            return 1;
         }
-
-        // Skip spaces and newlines
-        for (; *word_start == ' ' || *word_start == '\n'; word_start++) {
-            if (*word_start == '\n') {
-                y_offset -= height; // Move to the next line
-                x_offset = 0;      // Reset horizontal position
-            }
+        printf("Fitting the text in %.1f x %.1f mm: height %.2fmm\n", options->fit_width, options->fit_height, height);
+        if (options->stats) {
+            printf("  height found in %.3f s\n", (double)(clock() - start) / CLOCKS_PER_SEC);
         }
-
-        x_offset += scale*4; // Add spacing between words
     }
 
-    // Ensure the pen is up and return to the origin at the end
-    if (previous_pen_state != 0) {
-        sprintf(buffer, "S0\n");
-        SendCommands(buffer);
-    }
+    // Send the G-code to the Arduino as the text is read, however long the file is
+    int result = WriteText(file, font, height, options, buffer, send);
+    fclose(file);
+    return result == 0 ? 0 : 1;
+}
 
-    sprintf(buffer, "G0 X0 Y0\n");
-    SendCommands(buffer);
+//In resident mode, asks whether there is another job to write
+int AskForAnotherJob(void) {
+    char answer = 'n';
+    printf("Write another text file? (y/n): ");
+    scanf(" %c", &answer);
+    return answer == 'y' || answer == 'Y';
+}
+
+//Between pages, waits while the user puts the next sheet of paper in. The pen is already home.
+void ChangePaper(int page) {
+    char answer;
+    printf("Put in a new sheet for page %d, then enter c to carry on: ", page);
+    scanf(" %c", &answer);
+}
+
+//Handles "--font-file NAME=FILE" by loading the file into the font registry under NAME
+int ParseFontOption(const char *option, int font_options) {
+    const char *equals = strchr(option, '=');
+    if (!equals || equals == option || equals - option >= FONT_NAME_SIZE) {
+        printf("Invalid font option '%s', expected NAME=FILE.\n", option);
+        return -1;
+    }
+    char name[FONT_NAME_SIZE];
+    memcpy(name, option, equals - option);
+    name[equals - option] = '\0';
+    return RegisterFont(name, equals + 1, font_options);
 }
 
 //This function was already been provided from the original skeleton code.
 // Function to send G-code commands to the robot or emulator
 void SendCommands(char *buffer) {
     PrintBuffer(&buffer[0]); // Send the buffer contents via RS232
-    Sleep(100); // Optional delay to stabilise communication
+    Sleep(SEND_DELAY_MS); // Optional delay to stabilise communication
+}
+
+//Used in place of SendCommands for --estimate, the estimator has already counted the command
+void DiscardCommands(char *buffer) {
+    (void)buffer;
+}
+
+//Used in place of SendCommands for --simulate, the robot model runs each command as the robot would
+void SimulateCommands(char *buffer) {
+    SimulateGCode(&simulator, buffer);
+}
+
+//Runs the simulated robot to the end of the job, prints what it did and draws the image. Returns -1 if there were
+//lines the robot would not understand or the image could not be written.
+int EndSimulation(const char *image_file, float pixels_per_mm, FILE *move_times) {
+    PrintSimulation(&simulator, FinishSimulation(&simulator));
+    int result = simulator.errors > 0 ? -1 : 0;
+    if (image_file && WriteSimulation(&simulator, image_file, pixels_per_mm) != 0) {
+        result = -1;
+    }
+    FreeSimulation(&simulator);
+    if (move_times) {
+        fclose(move_times);
+    }
+    return result;
 }
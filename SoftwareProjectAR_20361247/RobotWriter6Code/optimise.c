@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "optimise.h"
+#include "gcode.h"
+
+#define DEADLINE_CHECK_EVERY 256    // Strokes 2-opt looks at between checks of the time budget
+#define NEIGHBOURS 16               // Nearest ends 2-opt tries joining each end to
+
+static float Distance(const StrokePoint *a, const StrokePoint *b) {
+    return hypotf(b->x - a->x, b->y - a->y);
+}
+
+static const StrokePoint *StrokeStart(const StrokeList *list, const Stroke *stroke) {
+    return &list->points[stroke->first];
+}
+
+static const StrokePoint *StrokeEnd(const StrokeList *list, const Stroke *stroke) {
+    return &list->points[stroke->first + stroke->count - 1];
+}
+
+//Adds up the pen-up moves needed to draw the strokes in order, starting with the pen at (x, y)
+float PenUpTravel(const StrokeList *list, float x, float y) {
+    StrokePoint pen = {x, y};
+    float travel = 0;
+    for (int i = 0; i < list->num_strokes; i++) {
+        travel += Distance(&pen, StrokeStart(list, &list->strokes[i]));
+        pen = *StrokeEnd(list, &list->strokes[i]);
+    }
+    return travel;
+}
+
+// A uniform grid over the ends of the strokes not drawn yet, so finding the nearest one only looks at the cells
+// around the pen instead of every stroke on the page. End e is the start of stroke e / 2 if e is even, its end if odd.
+typedef struct {
+    float min_x, min_y, cell_size;
+    int columns, rows;
+    int *cell_first;            // Where each cell's ends start in ends, one extra entry at the end
+    int *cell_count;            // How many of a cell's ends are still live (they are kept at the front)
+    int *ends;
+    int *position;              // Where each end is in ends, so it can be removed from its cell straight away
+    StrokePoint *points;        // Where each end was when the grid was built
+    int live;                   // Ends left in the grid
+} EndGrid;
+
+static const StrokePoint *EndPoint(const StrokeList *list, int end) {
+    const Stroke *stroke = &list->strokes[end / 2];
+    return end % 2 ? StrokeEnd(list, stroke) : StrokeStart(list, stroke);
+}
+
+static int CellOf(const EndGrid *grid, float value, float min, int cells) {
+    int cell = (int)((value - min) / grid->cell_size);
+    return cell < 0 ? 0 : (cell >= cells ? cells - 1 : cell);
+}
+
+static int GridCell(const EndGrid *grid, const StrokePoint *point) {
+    return CellOf(grid, point->y, grid->min_y, grid->rows) * grid->columns + CellOf(grid, point->x, grid->min_x, grid->columns);
+}
+
+static void FreeGrid(EndGrid *grid) {
+    free(grid->cell_first);
+    free(grid->cell_count);
+    free(grid->ends);
+    free(grid->position);
+    free(grid->points);
+}
+
+// Buckets the ends of every stroke not used yet. The cells are sized for about two ends each.
+static int BuildGrid(EndGrid *grid, const StrokeList *list, const char *used) {
+    int n = list->num_strokes;
+    float max_x = 0, max_y = 0;
+    grid->live = 0;
+    for (int i = 0; i < n; i++) {
+        if (used[i]) {
+            continue;
+        }
+        for (int e = 2 * i; e <= 2 * i + 1; e++) {
+            const StrokePoint *point = EndPoint(list, e);
+            if (grid->live == 0 || point->x < grid->min_x) grid->min_x = point->x;
+            if (grid->live == 0 || point->y < grid->min_y) grid->min_y = point->y;
+            if (grid->live == 0 || point->x > max_x) max_x = point->x;
+            if (grid->live == 0 || point->y > max_y) max_y = point->y;
+            grid->live++;
+        }
+    }
+
+    float width = max_x - grid->min_x, height = max_y - grid->min_y;
+    float area = (width > 1.0f ? width : 1.0f) * (height > 1.0f ? height : 1.0f); // A single line of text has no height
+    grid->cell_size = sqrtf(area * 2 / (grid->live > 0 ? grid->live : 1));
+    if (grid->cell_size < 0.1f) {
+        grid->cell_size = 0.1f;
+    }
+    grid->columns = (int)(width / grid->cell_size) + 1;
+    grid->rows = (int)(height / grid->cell_size) + 1;
+
+    int cells = grid->columns * grid->rows;
+    grid->cell_first = calloc(cells + 1, sizeof(int));
+    grid->cell_count = calloc(cells, sizeof(int));
+    grid->ends = malloc((grid->live + 1) * sizeof(int));
+    grid->position = malloc(2 * n * sizeof(int));
+    grid->points = malloc(2 * n * sizeof(StrokePoint));
+    if (!grid->cell_first || !grid->cell_count || !grid->ends || !grid->position || !grid->points) {
+        FreeGrid(grid);
+        return -1;
+    }
+
+    // Count the ends in each cell, turn the counts into starting points, then drop every end into its cell
+    for (int e = 0; e < 2 * n; e++) {
+        if (!used[e / 2]) {
+            grid->points[e] = *EndPoint(list, e);
+            grid->cell_count[GridCell(grid, &grid->points[e])]++;
+        }
+    }
+    for (int c = 0; c < cells; c++) {
+        grid->cell_first[c + 1] = grid->cell_first[c] + grid->cell_count[c];
+        grid->cell_count[c] = 0;
+    }
+    for (int e = 0; e < 2 * n; e++) {
+        if (!used[e / 2]) {
+            int cell = GridCell(grid, &grid->points[e]);
+            grid->position[e] = grid->cell_first[cell] + grid->cell_count[cell]++;
+            grid->ends[grid->position[e]] = e;
+        }
+    }
+    return 0;
+}
+
+// Takes an end out of its cell by swapping the cell's last live end into its place
+static void RemoveEnd(EndGrid *grid, int end) {
+    int cell = GridCell(grid, &grid->points[end]);
+    int last = grid->cell_first[cell] + --grid->cell_count[cell];
+    int moved = grid->ends[last];
+    grid->ends[grid->position[end]] = moved;
+    grid->position[moved] = grid->position[end];
+    grid->live--;
+}
+
+// The live end closest to the pen. Looks at rings of cells further and further out and stops once nothing in the
+// next ring could be closer than the best end found so far.
+static int NearestEnd(const EndGrid *grid, const StrokePoint *pen) {
+    int column = (int)floorf((pen->x - grid->min_x) / grid->cell_size);
+    int row = (int)floorf((pen->y - grid->min_y) / grid->cell_size);
+    int best = -1;
+    float best_distance = 0;
+
+    // The pen can be off the grid (at the start of a page), so start with the first ring that touches it
+    int first_ring = 0;
+    if (-column > first_ring) first_ring = -column;
+    if (column - (grid->columns - 1) > first_ring) first_ring = column - (grid->columns - 1);
+    if (-row > first_ring) first_ring = -row;
+    if (row - (grid->rows - 1) > first_ring) first_ring = row - (grid->rows - 1);
+    int last_ring = first_ring + (grid->columns > grid->rows ? grid->columns : grid->rows);
+
+    for (int ring = first_ring; ring <= last_ring; ring++) {
+        for (int r = row - ring; r <= row + ring; r++) {
+            if (r < 0 || r >= grid->rows) {
+                continue;
+            }
+            // Only the edge of the ring: every column on its top and bottom rows, the two ends of the rows between
+            int step = (r == row - ring || r == row + ring) ? 1 : 2 * ring;
+            for (int c = column - ring; c <= column + ring; c += step > 0 ? step : 1) {
+                if (c < 0 || c >= grid->columns) {
+                    continue;
+                }
+                int cell = r * grid->columns + c;
+                for (int k = 0; k < grid->cell_count[cell]; k++) {
+                    int end = grid->ends[grid->cell_first[cell] + k];
+                    float distance = Distance(pen, &grid->points[end]);
+                    // Ties go to the lower end so the order does not depend on how the cells were filled
+                    if (best < 0 || distance < best_distance || (distance == best_distance && end < best)) {
+                        best = end;
+                        best_distance = distance;
+                    }
+                }
+            }
+        }
+        if (best >= 0 && best_distance <= ring * grid->cell_size) {
+            break;
+        }
+    }
+    return best;
+}
+
+// Nearest neighbour: from where the pen is, always go to the closest end of a stroke not drawn yet
+static void NearestNeighbourOrder(StrokeList *list, float x, float y) {
+    int n = list->num_strokes;
+    Stroke *order = malloc(n * sizeof(Stroke));
+    char *used = calloc(n, 1);
+    EndGrid grid;
+    if (!order || !used || BuildGrid(&grid, list, used) != 0) {
+        free(order);
+        free(used);
+        return; // Not enough memory to reorder, the strokes just stay in text order
+    }
+    int built = grid.live;
+
+    StrokePoint pen = {x, y};
+    for (int k = 0; k < n; k++) {
+        // Once most of the page is drawn the grid is mostly empty cells, so build a smaller one over what is left
+        if (grid.live < built / 4 && grid.live > 64) {
+            EndGrid smaller;
+            if (BuildGrid(&smaller, list, used) == 0) {
+                FreeGrid(&grid);
+                grid = smaller;
+                built = grid.live;
+            }
+        }
+
+        int end = NearestEnd(&grid, &pen);
+        int best = end / 2;
+        RemoveEnd(&grid, 2 * best);
+        RemoveEnd(&grid, 2 * best + 1);
+        used[best] = 1;
+        order[k] = list->strokes[best];
+        if (end % 2) {
+            ReverseStroke(list, &order[k]);
+        }
+        pen = *StrokeEnd(list, &order[k]);
+    }
+
+    memcpy(list->strokes, order, n * sizeof(Stroke));
+    FreeGrid(&grid);
+    free(order);
+    free(used);
+}
+
+// Where 2-opt has got to: which stroke is at each position and the other way round. Strokes are numbered by
+// where nearest neighbour put them, the same numbers the grid uses.
+typedef struct {
+    StrokeList *list;
+    StrokePoint origin;
+    int *stroke_at;             // Stroke number at each position
+    int *position_of;           // Position of each stroke number
+    char *flipped;              // Set while a stroke is drawn the other way round from when the grid was built
+} Tour;
+
+// Reverses the strokes at positions a..b, their order and each one's direction, if that shortens the pen-up travel.
+// Only the travel into the run and out of it changes: before -> first ... last -> after becomes before -> last ...
+// first -> after.
+static int TryReversal(Tour *tour, int a, int b) {
+    StrokeList *list = tour->list;
+    int n = list->num_strokes;
+    const StrokePoint *before = a > 0 ? StrokeEnd(list, &list->strokes[a - 1]) : &tour->origin;
+    const StrokePoint *first = StrokeStart(list, &list->strokes[a]);
+    const StrokePoint *last = StrokeEnd(list, &list->strokes[b]);
+    const StrokePoint *after = b + 1 < n ? StrokeStart(list, &list->strokes[b + 1]) : NULL;
+
+    float old_travel = Distance(before, first) + (after ? Distance(last, after) : 0);
+    float new_travel = Distance(before, last) + (after ? Distance(first, after) : 0);
+    if (new_travel >= old_travel - 1e-4f) {
+        return 0;
+    }
+
+    for (int i = a, j = b; i <= j; i++, j--) {
+        Stroke swap = list->strokes[i];
+        list->strokes[i] = list->strokes[j];
+        list->strokes[j] = swap;
+        int number = tour->stroke_at[i];
+        tour->stroke_at[i] = tour->stroke_at[j];
+        tour->stroke_at[j] = number;
+
+        ReverseStroke(list, &list->strokes[i]);
+        tour->flipped[tour->stroke_at[i]] ^= 1;
+        tour->position_of[tour->stroke_at[i]] = i;
+        if (i != j) {
+            ReverseStroke(list, &list->strokes[j]);
+            tour->flipped[tour->stroke_at[j]] ^= 1;
+            tour->position_of[tour->stroke_at[j]] = j;
+        }
+    }
+    return 1;
+}
+
+// Lists the NEIGHBOURS closest ends to each end, nearest first, from the grid cells around it (-1 where there are
+// fewer). A stroke's own other end is left out, joining a stroke to itself is not a move.
+static int *FindNeighbours(const EndGrid *grid, int num_ends) {
+    int *neighbours = malloc((size_t)num_ends * NEIGHBOURS * sizeof(int));
+    if (!neighbours) {
+        return NULL;
+    }
+    for (int e = 0; e < num_ends; e++) {
+        int *list = &neighbours[e * NEIGHBOURS];
+        float distances[NEIGHBOURS];
+        int found = 0;
+        int column = CellOf(grid, grid->points[e].x, grid->min_x, grid->columns);
+        int row = CellOf(grid, grid->points[e].y, grid->min_y, grid->rows);
+
+        for (int r = row - 1; r <= row + 1; r++) {
+            for (int c = column - 1; c <= column + 1; c++) {
+                if (r < 0 || r >= grid->rows || c < 0 || c >= grid->columns) {
+                    continue;
+                }
+                int cell = r * grid->columns + c;
+                for (int k = 0; k < grid->cell_count[cell]; k++) {
+                    int other = grid->ends[grid->cell_first[cell] + k];
+                    if (other / 2 == e / 2) {
+                        continue;
+                    }
+                    // Insertion into the sorted list, dropping the furthest once it is full
+                    float distance = Distance(&grid->points[e], &grid->points[other]);
+                    int at = found < NEIGHBOURS ? found++ : NEIGHBOURS;
+                    while (at > 0 && distances[at - 1] > distance) {
+                        if (at < NEIGHBOURS) {
+                            distances[at] = distances[at - 1];
+                            list[at] = list[at - 1];
+                        }
+                        at--;
+                    }
+                    if (at < NEIGHBOURS) {
+                        distances[at] = distance;
+                        list[at] = other;
+                    }
+                }
+            }
+        }
+        for (int k = found; k < NEIGHBOURS; k++) {
+            list[k] = -1;
+        }
+    }
+    return neighbours;
+}
+
+// 2-opt: keep reversing runs of strokes while it shortens the travel, until nothing does or the time runs out.
+// Trying every run is quadratic, so only runs that would join up an end with one of its nearest neighbours are
+// tried. Neighbour lists are worked out once from the grid, the ends themselves never move, only which end of a
+// stroke is drawn first.
+static void TwoOpt(StrokeList *list, float x, float y, clock_t deadline) {
+    int n = list->num_strokes;
+    Tour tour = {list, {x, y}, malloc(n * sizeof(int)), malloc(n * sizeof(int)), calloc(n, 1)};
+    EndGrid grid;
+    int *neighbours = NULL;
+    if (!tour.stroke_at || !tour.position_of || !tour.flipped || BuildGrid(&grid, list, tour.flipped) != 0) {
+        free(tour.stroke_at);
+        free(tour.position_of);
+        free(tour.flipped);
+        return;
+    }
+    neighbours = FindNeighbours(&grid, 2 * n);
+    if (!neighbours) {
+        FreeGrid(&grid);
+        free(tour.stroke_at);
+        free(tour.position_of);
+        free(tour.flipped);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        tour.stroke_at[i] = i;
+        tour.position_of[i] = i;
+    }
+
+    // Reading the clock costs more than trying a stroke, so it is only checked every so often
+    int improved = 1, out_of_time = 0;
+    while (improved && !out_of_time) {
+        improved = 0;
+        for (int i = 1; i < n && !out_of_time; i++) {
+            if (i % DEADLINE_CHECK_EVERY == 0 && clock() >= deadline) {
+                out_of_time = 1;
+            }
+            // The pen-up move into position i goes from the end of the stroke before it to the start of stroke i.
+            // Look for a stroke end near the first to move to instead (reversing i..j), or a stroke start near the
+            // second to come from (reversing m..i-1). The new move has to be shorter than this one to be any use.
+            for (int side = 0; side < 2; side++) {
+                int before = tour.stroke_at[i - 1], current = tour.stroke_at[i];
+                int before_end = 2 * before + (1 ^ tour.flipped[before]);
+                int current_start = 2 * current + tour.flipped[current];
+                int from = side == 0 ? before_end : current_start;
+                float limit = Distance(StrokeEnd(list, &list->strokes[i - 1]), StrokeStart(list, &list->strokes[i]));
+
+                for (int k = 0; k < NEIGHBOURS; k++) {
+                    int end = neighbours[from * NEIGHBOURS + k];
+                    if (end < 0 || Distance(&grid.points[from], &grid.points[end]) >= limit) {
+                        break; // The rest are further away still
+                    }
+                    int number = end / 2;
+                    int position = tour.position_of[number];
+                    int is_end = (end % 2) ^ tour.flipped[number]; // Is this point the stroke's last one now
+                    int reversed;
+                    if (side == 0) {
+                        reversed = position >= i && is_end && TryReversal(&tour, i, position);
+                    }
+                    else {
+                        reversed = position < i && !is_end && TryReversal(&tour, position, i - 1);
+                    }
+                    if (reversed) {
+                        improved = 1;
+                        break; // The move into position i has changed, the rest of the list was for the old one
+                    }
+                }
+            }
+        }
+    }
+
+    free(neighbours);
+    FreeGrid(&grid);
+    free(tour.stroke_at);
+    free(tour.position_of);
+    free(tour.flipped);
+}
+
+//Reorders the strokes, drawing any of them backwards where that helps, so the pen travels less with the pen up.
+//Starts from a nearest-neighbour order and improves it with 2-opt for at most budget_seconds. Both search a grid of
+//stroke ends instead of every stroke, so a whole page of strokes takes milliseconds rather than growing with its square.
+void OrderStrokes(StrokeList *list, float x, float y, double budget_seconds) {
+    clock_t deadline = clock() + (clock_t)(budget_seconds * CLOCKS_PER_SEC);
+    if (list->num_strokes < 2) {
+        return;
+    }
+    NearestNeighbourOrder(list, x, y);
+    TwoOpt(list, x, y, deadline);
+}
+
+//Looks ahead from each stroke to the next: if it starts within distance (mm) of where this one ends, lifting the pen
+//would buy nothing the machine could draw, so the two are merged into one polyline and the pen stays down for the
+//hop. A next stroke starting on the very same point just carries on from it. Returns how many pen lifts went.
+int JoinStrokes(StrokeList *list, float distance) {
+    if (list->num_strokes < 2) {
+        return 0;
+    }
+    // The merged strokes are copied into a new array, a stroke's points are not always next to the one before it's
+    StrokePoint *points = malloc(list->num_points * sizeof(StrokePoint));
+    if (!points) {
+        return 0; // Not enough memory, the pen just gets lifted as before
+    }
+
+    int num_points = 0, num_strokes = 0, joined = 0;
+    for (int i = 0; i < list->num_strokes; i++) {
+        Stroke stroke = list->strokes[i]; // Copied first, merged strokes are written back over the same array
+        const StrokePoint *from = &list->points[stroke.first];
+        int skip = 0;
+
+        if (num_strokes > 0 && Distance(&points[num_points - 1], &from[0]) <= distance) {
+            const StrokePoint *end = &points[num_points - 1];
+            skip = fabsf(end->x - from[0].x) < SAME_POINT && fabsf(end->y - from[0].y) < SAME_POINT;
+            list->strokes[num_strokes - 1].count += stroke.count - skip;
+            joined++;
+        }
+        else {
+            list->strokes[num_strokes].first = num_points;
+            list->strokes[num_strokes].count = stroke.count;
+            num_strokes++;
+        }
+        memcpy(&points[num_points], &from[skip], (stroke.count - skip) * sizeof(StrokePoint));
+        num_points += stroke.count - skip;
+    }
+
+    free(list->points);
+    list->max_points = list->num_points;
+    list->points = points;
+    list->num_points = num_points;
+    list->num_strokes = num_strokes;
+    return joined;
+}
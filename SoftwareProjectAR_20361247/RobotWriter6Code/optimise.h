@@ -0,0 +1,11 @@
+#ifndef OPTIMISE_H_INCLUDED
+#define OPTIMISE_H_INCLUDED
+
+#include "stroke.h"
+
+//Passes that rework a stroke list before it is emitted
+float PenUpTravel(const StrokeList *list, float x, float y);    // Pen-up distance (mm) to draw the list from (x, y)
+void OrderStrokes(StrokeList *list, float x, float y, double budget_seconds); // Reorder and reverse strokes for less pen-up travel
+int JoinStrokes(StrokeList *list, float distance);              // Merge strokes that start within distance of the last one's end
+
+#endif // OPTIMISE_H_INCLUDED
@@ -1,3 +1,10 @@
+#if (defined(__linux__) || defined(__FreeBSD__)) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L     // nanosleep() is POSIX, not part of plain -std=c11
+#endif
+#if defined(__linux__) || defined(__FreeBSD__)
+#include <time.h>
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -5,6 +12,18 @@
 #include "rs232.h"
 
 
+#if defined(__linux__) || defined(__FreeBSD__)
+// Waits ms milliseconds, the same as Sleep() on Windows
+void SleepMilliseconds (unsigned int ms)
+{
+    struct timespec wait;
+    wait.tv_sec = ms / 1000;
+    wait.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&wait, NULL);
+}
+#endif
+
+
 //#define Serial_Mode
 
 #ifdef Serial_Mode
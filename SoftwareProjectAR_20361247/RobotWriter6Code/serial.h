@@ -6,6 +6,14 @@
 #define SERIAL_H_INCLUDED
 
 
+// Sleep() comes from windows.h on Windows, this gives the Linux build the same call
+#if defined(__linux__) || defined(__FreeBSD__)
+void SleepMilliseconds (unsigned int ms);
+#ifndef Sleep
+#define Sleep(ms) SleepMilliseconds(ms)
+#endif
+#endif
+
 #define cport_nr    5                  /* COM number minus 1 */
 #define bdrate      115200              /* 115200  */
 
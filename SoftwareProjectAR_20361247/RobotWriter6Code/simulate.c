@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "simulate.h"
+#include "gcode.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define ARC_FLATNESS 0.01f        // Furthest (mm) the straight pieces an arc is drawn with may be from the arc
+#define SIMULATE_LINE_SIZE 256    // Longest line read from a G-code file, GRBL itself takes 80
+#define IMAGE_MARGIN 4            // Blank pixels round the ink
+#define MAX_IMAGE_BYTES (1L << 30) // Biggest PNG bitmap drawn, a page of text at 10 pixels a mm is a few MB
+#define STORED_BLOCK_SIZE 65535   // Most a stored (uncompressed) deflate block can hold
+
+void StartSimulation(Simulator *simulator, float acceleration, long baud, double send_seconds) {
+    simulator->x = simulator->y = 0;
+    simulator->relative = 0;
+    simulator->mode = 0;
+    simulator->feed = DEFAULT_FEED; // What the robot runs at until it is sent an F, as the emitter assumes too
+    simulator->pen = 0;
+    simulator->last_list = -1;
+    simulator->stopping = 0;
+    simulator->pause = 0;
+    StartEstimate(&simulator->estimator, acceleration, baud, send_seconds);
+    InitStrokes(&simulator->ink);
+    InitStrokes(&simulator->travel);
+    simulator->lines = simulator->moves = 0;
+    simulator->errors = 0;
+    simulator->draw_length = simulator->travel_length = 0;
+}
+
+void FreeSimulation(Simulator *simulator) {
+    FreeStrokes(&simulator->ink);
+    FreeStrokes(&simulator->travel);
+}
+
+// A pen change and the G4 that follows it are one stop for the robot, so the stop only goes in the estimator once
+// the next move comes or the command is sent
+static void PutStop(Simulator *simulator) {
+    if (simulator->stopping) {
+        EstimateStop(&simulator->estimator, simulator->pause);
+        simulator->stopping = 0;
+        simulator->pause = 0;
+    }
+}
+
+// Takes the pen on to (x, y), adding to the ink if it is down and to the travel if it is up
+static void TracePen(Simulator *simulator, float x, float y) {
+    int list = simulator->pen;
+    StrokeList *strokes = list ? &simulator->ink : &simulator->travel;
+    int result = 0;
+    if (simulator->last_list != list) {
+        result = BeginStroke(strokes, simulator->x, simulator->y);
+    }
+    if (result == 0 && AddStrokePoint(strokes, x, y) == 0) {
+        simulator->last_list = list;
+    }
+    else {
+        simulator->last_list = -1; // Out of memory, the next move starts a stroke of its own
+    }
+    simulator->x = x;
+    simulator->y = y;
+}
+
+// A G0/G1 straight to (x, y), or a G2/G3 round the centre (centre_x, centre_y) from where the pen is
+static void SimulateMove(Simulator *simulator, int mode, float x, float y, double centre_x, double centre_y) {
+    double start_x = simulator->x, start_y = simulator->y;
+    double length = hypot(x - start_x, y - start_y);
+
+    if (mode >= 2) {
+        // Same sweep the emitter works out: clockwise for G2, all the way round if the arc ends where it starts
+        double radius = hypot(start_x - centre_x, start_y - centre_y);
+        double start_angle = atan2(start_y - centre_y, start_x - centre_x);
+        double sweep = atan2(y - centre_y, x - centre_x) - start_angle;
+        double direction = mode == 2 ? -1 : 1;
+        sweep *= direction;
+        if (sweep <= 0) {
+            sweep += 2 * M_PI;
+        }
+        length = sweep * radius;
+
+        // Straight pieces short enough that none bulges out from the arc by more than ARC_FLATNESS
+        int pieces = 1;
+        if (radius > ARC_FLATNESS) {
+            pieces = (int)ceil(sweep / (2 * acos(1 - ARC_FLATNESS / radius)));
+        }
+        for (int i = 1; i < pieces; i++) {
+            double angle = start_angle + direction * sweep * i / pieces;
+            TracePen(simulator, (float)(centre_x + radius * cos(angle)), (float)(centre_y + radius * sin(angle)));
+        }
+    }
+    if (length <= 0) {
+        return;
+    }
+    TracePen(simulator, x, y);
+
+    PutStop(simulator);
+    EstimateMove(&simulator->estimator, (float)(x - start_x), (float)(y - start_y), (float)length, simulator->feed);
+    simulator->moves++;
+    if (simulator->pen) {
+        simulator->draw_length += length;
+    }
+    else {
+        simulator->travel_length += length;
+    }
+}
+
+// Runs one line of G-code the way GRBL does: every word is read first, then the modes change, then the pen, then
+// the move. A line with anything the robot would not understand is rejected whole, and so is an arc with no centre
+// (no I or J, or both 0), which GRBL refuses as well.
+static void SimulateLine(Simulator *simulator, const char *line) {
+    double x = 0, y = 0, i = 0, j = 0, seconds = 0;
+    int has_x = 0, has_y = 0, dwell = 0, known = 1;
+    int mode = simulator->mode, relative = simulator->relative, feed = simulator->feed, pen = simulator->pen;
+    const char *c = line;
+
+    simulator->lines++;
+    simulator->estimator.line = simulator->lines;
+    while (*c != '\0' && *c != '\n' && *c != ';') {
+        char letter = (char)toupper((unsigned char)*c);
+        if (letter == ' ' || letter == '\t' || letter == '\r') {
+            c++;
+            continue;
+        }
+        if (letter == '(') {
+            while (*c != '\0' && *c != '\n' && *c != ')') {
+                c++;
+            }
+            c += *c == ')';
+            continue;
+        }
+        char *after;
+        double value = strtod(c + 1, &after);
+        if (after == c + 1) {
+            known = 0;
+            break;
+        }
+        c = after;
+
+        if (letter == 'G' && value >= 0 && value <= 3 && value == (int)value) {
+            mode = (int)value;
+        }
+        else if (letter == 'G' && value == 4) {
+            dwell = 1;
+        }
+        else if (letter == 'G' && (value == 90 || value == 91)) {
+            relative = value == 91;
+        }
+        else if (letter == 'G' && value == 21) {
+            // Millimetres, which it always is
+        }
+        else if (letter == 'X' || letter == 'Y') {
+            *(letter == 'X' ? &x : &y) = value;
+            *(letter == 'X' ? &has_x : &has_y) = 1;
+        }
+        else if (letter == 'I' || letter == 'J') {
+            *(letter == 'I' ? &i : &j) = value;
+        }
+        else if (letter == 'F' && value > 0) {
+            feed = (int)value;
+        }
+        else if (letter == 'S' && value >= 0) {
+            pen = value > 0;
+        }
+        else if (letter == 'P' && value >= 0) {
+            seconds = value;
+        }
+        else if (letter == 'M' && (value == 3 || value == 5)) {
+            // The sketch's pen is worked by S alone
+        }
+        else {
+            known = 0;
+            break;
+        }
+    }
+
+    if (known && mode >= 2 && (has_x || has_y) && i == 0 && j == 0) {
+        known = 0;
+    }
+    if (!known) {
+        if (simulator->errors < SIMULATE_ERRORS_SHOWN) {
+            int length = (int)strcspn(line, "\n");
+            printf("Simulation: line %ld not understood: %.*s\n", simulator->lines, length, line);
+        }
+        simulator->errors++;
+        return;
+    }
+    simulator->relative = relative;
+    simulator->feed = feed;
+    if (pen != simulator->pen) {
+        simulator->stopping = 1;
+        simulator->pen = pen;
+    }
+    if (dwell) {
+        simulator->stopping = 1;
+        simulator->pause += seconds;
+        return;
+    }
+    simulator->mode = mode;
+    if (has_x || has_y) {
+        float to_x = has_x ? (float)(relative ? simulator->x + x : x) : simulator->x;
+        float to_y = has_y ? (float)(relative ? simulator->y + y : y) : simulator->y;
+        SimulateMove(simulator, mode, to_x, to_y, simulator->x + i, simulator->y + j);
+    }
+}
+
+//Runs the commands of one send, then they go over the serial link together like they did from the emitter
+void SimulateGCode(Simulator *simulator, const char *commands) {
+    const char *line = commands;
+    while (*line != '\0') {
+        if (*line != '\n') {
+            SimulateLine(simulator, line);
+        }
+        line += strcspn(line, "\n");
+        line += *line == '\n';
+    }
+    PutStop(simulator);
+    EstimateSend(&simulator->estimator, (long)strlen(commands));
+}
+
+//Runs a G-code file, like the one the skeleton code wrote, a line at a time. Returns -1 if it could not be read.
+int SimulateFile(Simulator *simulator, FILE *file) {
+    char line[SIMULATE_LINE_SIZE];
+    while (fgets(line, sizeof(line), file)) {
+        size_t length = strlen(line);
+        if (length == sizeof(line) - 1 && line[length - 1] != '\n') {
+            // Far too long for the robot, count it as not understood and skip the rest of it
+            int c;
+            while ((c = getc(file)) != EOF && c != '\n') {
+            }
+            line[0] = '?';
+            line[1] = '\0';
+        }
+        SimulateGCode(simulator, line);
+    }
+    if (ferror(file)) {
+        perror("Error reading G-code file");
+        return -1;
+    }
+    return 0;
+}
+
+double FinishSimulation(Simulator *simulator) {
+    PutStop(simulator);
+    return FinishEstimate(&simulator->estimator);
+}
+
+// The box round everything the pen went over, with the pen up or down, and the origin it starts from
+static void Bounds(const Simulator *simulator, Box *box) {
+    box->min_x = box->min_y = box->max_x = box->max_y = 0;
+    StrokeBounds(&simulator->ink, box);
+    StrokeBounds(&simulator->travel, box);
+}
+
+void PrintSimulation(const Simulator *simulator, double seconds) {
+    Box box;
+    Bounds(simulator, &box);
+    long whole = (long)(seconds + 0.5);
+    printf("Simulation: %ld G-code lines, %ld moves, %ld:%02ld:%02ld to write\n", simulator->lines, simulator->moves,
+           whole / 3600, whole / 60 % 60, whole % 60);
+    printf("  %.1f mm drawn in %d strokes, %.1f mm pen-up travel\n", simulator->draw_length,
+           simulator->ink.num_strokes, simulator->travel_length);
+    printf("  pen went from (%.2f, %.2f) to (%.2f, %.2f)\n", box.min_x, box.min_y, box.max_x, box.max_y);
+    printf("  moving %.1f s, pen changes %.1f s, waiting for the serial link %.1f s\n",
+           simulator->estimator.move_seconds, simulator->estimator.pause_seconds, simulator->estimator.wait_seconds);
+    if (simulator->errors > 0) {
+        printf("  %ld lines not understood\n", simulator->errors);
+    }
+}
+
+// Writes a list's strokes as one SVG path, y flipped so the page reads the right way up
+static void PutPath(FILE *file, const StrokeList *list, const char *style) {
+    if (list->num_strokes == 0) {
+        return;
+    }
+    fprintf(file, "<path fill=\"none\" %s d=\"", style);
+    for (int s = 0; s < list->num_strokes; s++) {
+        const Stroke *stroke = &list->strokes[s];
+        for (int i = 0; i < stroke->count; i++) {
+            const StrokePoint *point = &list->points[stroke->first + i];
+            fprintf(file, "%c%.2f %.2f", i == 0 ? 'M' : 'L', point->x, 0.0f - point->y);
+        }
+    }
+    fprintf(file, "\"/>\n");
+}
+
+static int WriteSVG(const Simulator *simulator, FILE *file) {
+    Box box;
+    Bounds(simulator, &box);
+    float width = box.max_x - box.min_x + 2, height = box.max_y - box.min_y + 2; // A mm of margin all round
+    fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.2fmm\" height=\"%.2fmm\" "
+            "viewBox=\"%.2f %.2f %.2f %.2f\">\n", width, height, box.min_x - 1, -box.max_y - 1, width, height);
+    PutPath(file, &simulator->travel, "stroke=\"#c0c0c0\" stroke-width=\"0.1\"");
+    PutPath(file, &simulator->ink, "stroke=\"black\" stroke-width=\"0.3\" stroke-linecap=\"round\" "
+            "stroke-linejoin=\"round\"");
+    fprintf(file, "</svg>\n");
+    return 0;
+}
+
+//A 1-bit image of the ink: each row is PNG's filter byte and then the pixels, 8 to a byte with 1 for white
+typedef struct {
+    unsigned char *rows;
+    long width, height, stride;
+} Bitmap;
+
+static void DrawLine(Bitmap *bitmap, float x0, float y0, float x1, float y1) {
+    long steps = (long)ceilf(fmaxf(fabsf(x1 - x0), fabsf(y1 - y0)));
+    for (long k = 0; k <= steps; k++) {
+        float t = steps > 0 ? (float)k / steps : 0;
+        long x = lroundf(x0 + (x1 - x0) * t), y = lroundf(y0 + (y1 - y0) * t);
+        if (x >= 0 && x < bitmap->width && y >= 0 && y < bitmap->height) {
+            bitmap->rows[y * bitmap->stride + 1 + x / 8] &= (unsigned char)~(0x80 >> (x % 8));
+        }
+    }
+}
+
+static unsigned long Crc(unsigned long crc, const unsigned char *data, size_t size) {
+    static unsigned long table[256];
+    if (table[1] == 0) {
+        for (unsigned long n = 0; n < 256; n++) {
+            unsigned long c = n;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+    }
+    crc ^= 0xFFFFFFFFUL;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFUL;
+}
+
+static void PutBigEndian(unsigned char *out, unsigned long value) {
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
+
+static void PutChunk(FILE *file, const char *type, const unsigned char *data, size_t size) {
+    unsigned char number[4];
+    PutBigEndian(number, (unsigned long)size);
+    fwrite(number, 1, 4, file);
+    fwrite(type, 1, 4, file);
+    fwrite(data, 1, size, file);
+    PutBigEndian(number, Crc(Crc(0, (const unsigned char *)type, 4), data, size));
+    fwrite(number, 1, 4, file);
+}
+
+// Writes the bitmap as a PNG. The pixel data goes in stored deflate blocks: at one bit a pixel it is small enough
+// as it is, and it needs no zlib.
+static int PutPNG(FILE *file, const Bitmap *bitmap) {
+    size_t raw = (size_t)bitmap->height * bitmap->stride;
+    size_t blocks = raw / STORED_BLOCK_SIZE + 1;
+    unsigned char *data = malloc(2 + raw + 5 * blocks + 4);
+    if (!data) {
+        perror("Error allocating the image");
+        return -1;
+    }
+
+    unsigned char header[13];
+    PutBigEndian(header, (unsigned long)bitmap->width);
+    PutBigEndian(header + 4, (unsigned long)bitmap->height);
+    header[8] = 1;  // Bits per pixel
+    header[9] = 0;  // Greyscale
+    header[10] = header[11] = header[12] = 0; // Deflate, adaptive filters, not interlaced
+
+    // zlib stream: header, the blocks, then the Adler-32 of the data
+    unsigned char *out = data;
+    *out++ = 0x78;
+    *out++ = 0x01;
+    unsigned long a = 1, b = 0;
+    size_t done = 0;
+    for (size_t block = 0; block < blocks; block++) {
+        size_t size = raw - done < STORED_BLOCK_SIZE ? raw - done : STORED_BLOCK_SIZE;
+        *out++ = block == blocks - 1;
+        out[0] = (unsigned char)size;
+        out[1] = (unsigned char)(size >> 8);
+        out[2] = (unsigned char)~size;
+        out[3] = (unsigned char)(~size >> 8);
+        out += 4;
+        memcpy(out, bitmap->rows + done, size);
+        for (size_t i = 0; i < size; i++) {
+            a = (a + out[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        out += size;
+        done += size;
+    }
+    PutBigEndian(out, (b << 16) | a);
+    out += 4;
+
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    fwrite(signature, 1, sizeof(signature), file);
+    PutChunk(file, "IHDR", header, sizeof(header));
+    PutChunk(file, "IDAT", data, out - data);
+    PutChunk(file, "IEND", NULL, 0);
+    free(data);
+    return 0;
+}
+
+static int WritePNG(const Simulator *simulator, FILE *file, float pixels_per_mm) {
+    Box box;
+    Bounds(simulator, &box);
+    Bitmap bitmap;
+    bitmap.width = (long)ceilf((box.max_x - box.min_x) * pixels_per_mm) + 1 + 2 * IMAGE_MARGIN;
+    bitmap.height = (long)ceilf((box.max_y - box.min_y) * pixels_per_mm) + 1 + 2 * IMAGE_MARGIN;
+    bitmap.stride = 1 + (bitmap.width + 7) / 8;
+    if ((double)bitmap.height * bitmap.stride > MAX_IMAGE_BYTES) {
+        printf("The image would be %ld x %ld pixels, try fewer pixels a mm.\n", bitmap.width, bitmap.height);
+        return -1;
+    }
+    bitmap.rows = malloc((size_t)bitmap.height * bitmap.stride);
+    if (!bitmap.rows) {
+        perror("Error allocating the image");
+        return -1;
+    }
+    memset(bitmap.rows, 0xFF, (size_t)bitmap.height * bitmap.stride);
+    for (long y = 0; y < bitmap.height; y++) {
+        bitmap.rows[y * bitmap.stride] = 0; // No filter
+    }
+
+    // Pixel centres, with the top of the image at the highest y
+    const StrokeList *ink = &simulator->ink;
+    for (int s = 0; s < ink->num_strokes; s++) {
+        const StrokePoint *points = &ink->points[ink->strokes[s].first];
+        for (int i = 1; i < ink->strokes[s].count; i++) {
+            DrawLine(&bitmap, (points[i - 1].x - box.min_x) * pixels_per_mm + IMAGE_MARGIN,
+                     (box.max_y - points[i - 1].y) * pixels_per_mm + IMAGE_MARGIN,
+                     (points[i].x - box.min_x) * pixels_per_mm + IMAGE_MARGIN,
+                     (box.max_y - points[i].y) * pixels_per_mm + IMAGE_MARGIN);
+        }
+    }
+    int result = PutPNG(file, &bitmap);
+    free(bitmap.rows);
+    return result;
+}
+
+//Draws what the simulated pen drew: an SVG with the pen-up travel in grey if the name ends in .svg, otherwise a
+//black and white PNG at pixels_per_mm
+int WriteSimulation(const Simulator *simulator, const char *path, float pixels_per_mm) {
+    size_t length = strlen(path);
+    int svg = length >= 4 && strcmp(path + length - 4, ".svg") == 0;
+    FILE *file = fopen(path, svg ? "w" : "wb");
+    if (!file) {
+        perror("Error opening image file");
+        return -1;
+    }
+    int result = svg ? WriteSVG(simulator, file) : WritePNG(simulator, file, pixels_per_mm);
+    if (fclose(file) != 0 && result == 0) {
+        perror("Error writing image file");
+        result = -1;
+    }
+    return result;
+}
@@ -0,0 +1,38 @@
+#ifndef SIMULATE_H_INCLUDED
+#define SIMULATE_H_INCLUDED
+
+#include <stdio.h>
+#include "stroke.h"
+#include "estimate.h"
+
+#define SIMULATE_PIXELS_PER_MM 10.0f // Default image resolution, a pixel for each 0.1mm the robot can draw
+#define SIMULATE_ERRORS_SHOWN 10     // Commands the simulator does not know are printed up to this many
+
+//Plays G-code through a model of the robot: it follows the controller's modes, position and pen like the firmware
+//does, keeps what the pen drew and how it got there, and times the moves with the estimator.
+typedef struct {
+    float x, y;                   // Where the pen is
+    int relative;                 // G91, X and Y are distances
+    int mode;                     // Last G0/G1/G2/G3
+    int feed;                     // F (mm/min)
+    int pen;                      // Whether the pen is down (S above 0)
+    int last_list;                // 1 if the last move carried on the ink, 0 the travel, -1 neither
+    int stopping;                 // A pen change is waiting to go in the estimator
+    double pause;                 // Seconds the robot waits at that stop (G4)
+    Estimator estimator;
+    StrokeList ink;               // What the pen drew
+    StrokeList travel;            // Moves with the pen up
+    long lines, moves;            // G-code lines and moves read
+    long errors;                  // Lines the robot would not understand
+    double draw_length, travel_length; // mm with the pen down and up
+} Simulator;
+
+void StartSimulation(Simulator *simulator, float acceleration, long baud, double send_seconds);
+void SimulateGCode(Simulator *simulator, const char *commands); // One send's worth of G-code, any number of lines
+int SimulateFile(Simulator *simulator, FILE *file);             // A G-code file, each line sent on its own
+double FinishSimulation(Simulator *simulator);                  // Run the robot to the end, returns the seconds taken
+void PrintSimulation(const Simulator *simulator, double seconds);
+int WriteSimulation(const Simulator *simulator, const char *path, float pixels_per_mm); // .svg, anything else is PNG
+void FreeSimulation(Simulator *simulator);
+
+#endif // SIMULATE_H_INCLUDED
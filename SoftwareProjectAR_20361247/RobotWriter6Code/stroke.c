@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "stroke.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define INITIAL_STROKES 256
+#define INITIAL_POINTS 1024
+
+void InitStrokes(StrokeList *list) {
+    list->strokes = NULL;
+    list->num_strokes = list->max_strokes = 0;
+    list->points = NULL;
+    list->num_points = list->max_points = 0;
+}
+
+void ClearStrokes(StrokeList *list) {
+    list->num_strokes = 0;
+    list->num_points = 0;
+}
+
+void FreeStrokes(StrokeList *list) {
+    free(list->strokes);
+    free(list->points);
+    InitStrokes(list);
+}
+
+// Makes room for extra_strokes more strokes and extra_points more points, doubling the arrays until they fit
+int ReserveStrokes(StrokeList *list, int extra_strokes, int extra_points) {
+    if (list->num_strokes + extra_strokes > list->max_strokes) {
+        int max = list->max_strokes ? list->max_strokes : INITIAL_STROKES;
+        while (list->num_strokes + extra_strokes > max) {
+            max *= 2;
+        }
+        Stroke *strokes = realloc(list->strokes, max * sizeof(Stroke));
+        if (!strokes) {
+            perror("Error allocating strokes");
+            return -1;
+        }
+        list->strokes = strokes;
+        list->max_strokes = max;
+    }
+    if (list->num_points + extra_points > list->max_points) {
+        int max = list->max_points ? list->max_points : INITIAL_POINTS;
+        while (list->num_points + extra_points > max) {
+            max *= 2;
+        }
+        StrokePoint *points = realloc(list->points, max * sizeof(StrokePoint));
+        if (!points) {
+            perror("Error allocating stroke points");
+            return -1;
+        }
+        list->points = points;
+        list->max_points = max;
+    }
+    return 0;
+}
+
+// Makes room for one more point (and stroke). Almost always there is room already.
+static int Grow(StrokeList *list, int new_stroke) {
+    if ((new_stroke && list->num_strokes == list->max_strokes) || list->num_points == list->max_points) {
+        return ReserveStrokes(list, new_stroke, 1);
+    }
+    return 0;
+}
+
+int BeginStroke(StrokeList *list, float x, float y) {
+    if (Grow(list, 1) != 0) {
+        return -1;
+    }
+    Stroke *stroke = &list->strokes[list->num_strokes++];
+    stroke->first = list->num_points;
+    stroke->count = 1;
+    list->points[list->num_points].x = x;
+    list->points[list->num_points].y = y;
+    list->num_points++;
+    return 0;
+}
+
+int AddStrokePoint(StrokeList *list, float x, float y) {
+    if (Grow(list, 0) != 0) {
+        return -1;
+    }
+    list->strokes[list->num_strokes - 1].count++;
+    list->points[list->num_points].x = x;
+    list->points[list->num_points].y = y;
+    list->num_points++;
+    return 0;
+}
+
+// Copies every stroke of from onto the end of the list, dy mm further up the page
+int AppendStrokes(StrokeList *list, const StrokeList *from, float dy) {
+    if (ReserveStrokes(list, from->num_strokes, from->num_points) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < from->num_strokes; i++) {
+        list->strokes[list->num_strokes + i].first = list->num_points + from->strokes[i].first;
+        list->strokes[list->num_strokes + i].count = from->strokes[i].count;
+    }
+    for (int i = 0; i < from->num_points; i++) {
+        list->points[list->num_points + i].x = from->points[i].x;
+        list->points[list->num_points + i].y = dy + from->points[i].y;
+    }
+    list->num_strokes += from->num_strokes;
+    list->num_points += from->num_points;
+    return 0;
+}
+
+void ReverseStroke(StrokeList *list, const Stroke *stroke) {
+    StrokePoint *points = &list->points[stroke->first];
+    for (int i = 0, j = stroke->count - 1; i < j; i++, j--) {
+        StrokePoint swap = points[i];
+        points[i] = points[j];
+        points[j] = swap;
+    }
+}
+
+// The same ink with the pen going the other way: the strokes in the opposite order, each one drawn end to start
+void ReverseStrokes(StrokeList *list, int first) {
+    for (int i = first, j = list->num_strokes - 1; i <= j; i++, j--) {
+        Stroke swap = list->strokes[i];
+        list->strokes[i] = list->strokes[j];
+        list->strokes[j] = swap;
+        ReverseStroke(list, &list->strokes[i]);
+        if (i != j) {
+            ReverseStroke(list, &list->strokes[j]);
+        }
+    }
+}
+
+//Grows the box to take in every point of the list. With SSE the points are taken four at a time: two points lie
+//x, y, x, y in one register, so one min and one max cover both of their coordinates.
+void StrokeBounds(const StrokeList *list, Box *box) {
+    const StrokePoint *points = list->points;
+    int i = 0;
+#if defined(__SSE2__)
+    __m128 low = _mm_setr_ps(box->min_x, box->min_y, box->min_x, box->min_y), low2 = low;
+    __m128 high = _mm_setr_ps(box->max_x, box->max_y, box->max_x, box->max_y), high2 = high;
+    for (; i + 4 <= list->num_points; i += 4) {
+        __m128 pair = _mm_loadu_ps(&points[i].x), pair2 = _mm_loadu_ps(&points[i + 2].x);
+        low = _mm_min_ps(low, pair);
+        high = _mm_max_ps(high, pair);
+        low2 = _mm_min_ps(low2, pair2);
+        high2 = _mm_max_ps(high2, pair2);
+    }
+    float lows[4], highs[4];
+    _mm_storeu_ps(lows, _mm_min_ps(low, low2));
+    _mm_storeu_ps(highs, _mm_max_ps(high, high2));
+    box->min_x = lows[0] < lows[2] ? lows[0] : lows[2];
+    box->min_y = lows[1] < lows[3] ? lows[1] : lows[3];
+    box->max_x = highs[0] > highs[2] ? highs[0] : highs[2];
+    box->max_y = highs[1] > highs[3] ? highs[1] : highs[3];
+#endif
+    for (; i < list->num_points; i++) {
+        box->min_x = points[i].x < box->min_x ? points[i].x : box->min_x;
+        box->min_y = points[i].y < box->min_y ? points[i].y : box->min_y;
+        box->max_x = points[i].x > box->max_x ? points[i].x : box->max_x;
+        box->max_y = points[i].y > box->max_y ? points[i].y : box->max_y;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef STROKE_H_INCLUDED
+#define STROKE_H_INCLUDED
+
+//A point on the page in absolute mm
+typedef struct {
+    float x;
+    float y;
+} StrokePoint;
+
+//A polyline drawn with the pen down from its first point to its last. The pen is up between strokes, so the
+//travel from one stroke's end to the next one's start is not stored - the emitter works it out.
+typedef struct {
+    int first;                  // Index of the first point in the list's points
+    int count;                  // Number of points (two equal points make a dot)
+} Stroke;
+
+//What the layout produces and every later pass works on: optimise, clip, estimate and finally emit
+typedef struct {
+    Stroke *strokes;
+    int num_strokes, max_strokes;
+    StrokePoint *points;
+    int num_points, max_points;
+} StrokeList;
+
+//A rectangle on the page (mm)
+typedef struct {
+    float min_x, min_y;
+    float max_x, max_y;
+} Box;
+
+void InitStrokes(StrokeList *list);
+void ClearStrokes(StrokeList *list);                    // Empty the list but keep its memory for the next page
+void FreeStrokes(StrokeList *list);
+int ReserveStrokes(StrokeList *list, int extra_strokes, int extra_points); // Make room to fill in directly
+int BeginStroke(StrokeList *list, float x, float y);    // Start a new stroke at a point
+int AddStrokePoint(StrokeList *list, float x, float y); // Carry the last stroke on to a point
+int AppendStrokes(StrokeList *list, const StrokeList *from, float dy); // Copy another list's strokes on the end, moved up dy
+void ReverseStroke(StrokeList *list, const Stroke *stroke); // Flip a stroke so it is drawn from the other end
+void ReverseStrokes(StrokeList *list, int first);       // Draw the strokes from first on backwards, last one first
+void StrokeBounds(const StrokeList *list, Box *box);    // Grow the box to take in every point
+
+#endif // STROKE_H_INCLUDED
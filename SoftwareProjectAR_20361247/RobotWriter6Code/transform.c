@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "transform.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Each point is worked out with the same multiplies and adds in the same order in every version, so they round
+// the same way. (A compiler allowed to fuse them into FMAs could break that, which is what the benchmark checks.)
+void TransformPointsScalar(const float *px, const float *py, int count, float x_offset, float y_offset, float scale,
+                           float shear, StrokePoint *out) {
+    for (int i = 0; i < count; i++) {
+        out[i].x = (x_offset + px[i] * scale) + py[i] * shear;
+        out[i].y = y_offset + py[i] * scale;
+    }
+}
+
+#if defined(__AVX__)
+// Eight points at a time from i on, returns where it got to
+static int TransformAVX(const float *px, const float *py, int i, int count, float x_offset, float y_offset,
+                        float scale, float shear, StrokePoint *out) {
+    __m256 x_add = _mm256_set1_ps(x_offset), y_add = _mm256_set1_ps(y_offset);
+    __m256 times = _mm256_set1_ps(scale), slant = _mm256_set1_ps(shear);
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(px + i), y = _mm256_loadu_ps(py + i);
+        __m256 page_x = _mm256_add_ps(_mm256_add_ps(x_add, _mm256_mul_ps(x, times)), _mm256_mul_ps(y, slant));
+        __m256 page_y = _mm256_add_ps(y_add, _mm256_mul_ps(y, times));
+        // Interleave into x, y pairs: the unpacks work within each 128-bit half, so the halves are put back in order
+        __m256 low = _mm256_unpacklo_ps(page_x, page_y), high = _mm256_unpackhi_ps(page_x, page_y);
+        _mm256_storeu_ps(&out[i].x, _mm256_permute2f128_ps(low, high, 0x20));
+        _mm256_storeu_ps(&out[i + 4].x, _mm256_permute2f128_ps(low, high, 0x31));
+    }
+    return i;
+}
+#endif
+
+#if defined(__SSE2__)
+// Four points at a time from i on, returns where it got to
+static int TransformSSE(const float *px, const float *py, int i, int count, float x_offset, float y_offset,
+                        float scale, float shear, StrokePoint *out) {
+    __m128 x_add = _mm_set1_ps(x_offset), y_add = _mm_set1_ps(y_offset);
+    __m128 times = _mm_set1_ps(scale), slant = _mm_set1_ps(shear);
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(px + i), y = _mm_loadu_ps(py + i);
+        __m128 page_x = _mm_add_ps(_mm_add_ps(x_add, _mm_mul_ps(x, times)), _mm_mul_ps(y, slant));
+        __m128 page_y = _mm_add_ps(y_add, _mm_mul_ps(y, times));
+        _mm_storeu_ps(&out[i].x, _mm_unpacklo_ps(page_x, page_y));
+        _mm_storeu_ps(&out[i + 2].x, _mm_unpackhi_ps(page_x, page_y));
+    }
+    return i;
+}
+#endif
+
+//The widest SIMD the build has first, then narrower for what is left: most characters have only a few dozen
+//points, so an AVX build still finishes a character off four at a time before going one at a time
+void TransformPoints(const float *px, const float *py, int count, float x_offset, float y_offset, float scale,
+                     float shear, StrokePoint *out) {
+    int i = 0;
+#if defined(__AVX__)
+    i = TransformAVX(px, py, i, count, x_offset, y_offset, scale, shear, out);
+#endif
+#if defined(__SSE2__)
+    i = TransformSSE(px, py, i, count, x_offset, y_offset, scale, shear, out);
+#endif
+    TransformPointsScalar(px + i, py + i, count - i, x_offset, y_offset, scale, shear, out + i);
+}
+
+const char *TransformKernel(void) {
+#if defined(__AVX__)
+    return "AVX";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "none";
+#endif
+}
+
+typedef void (*TransformFunction)(const float *px, const float *py, int count, float x_offset, float y_offset,
+                                  float scale, float shear, StrokePoint *out);
+
+// Moves every character of the font, over and over like a page of text, until BENCHMARK_POINTS points are done.
+// Returns the seconds it took.
+static double TimeTransform(TransformFunction transform, const FontData **glyphs, int num_glyphs, float scale,
+                            float shear, StrokePoint *out) {
+    clock_t start = clock();
+    long done = 0;
+    float x = 0, y = 0;
+    while (done < BENCHMARK_POINTS) {
+        for (int g = 0; g < num_glyphs; g++) {
+            transform(glyphs[g]->point_x, glyphs[g]->point_y, glyphs[g]->num_points, x, y, scale, shear, out);
+            done += glyphs[g]->num_points;
+            x += glyphs[g]->advance * scale;
+        }
+        x = 0;
+        y -= scale * FONT_UNITS_HIGH;
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+//Times the SIMD and scalar versions over the font's characters and checks they put every point in exactly the same
+//place, for a few positions down a long page. Returns -1 if they differ anywhere.
+int BenchmarkTransform(const Font *font, float height, float shear) {
+    const FontData *glyphs[MAX_FONT_DATA];
+    int num_glyphs = 0;
+    for (int ascii = 0; ascii < MAX_FONT_DATA; ascii++) {
+        const FontData *glyph = GetGlyph(font, ascii);
+        if (glyph && glyph->num_points > 0) {
+            glyphs[num_glyphs++] = glyph;
+        }
+    }
+    if (num_glyphs == 0) {
+        printf("The font has no characters to move.\n");
+        return -1;
+    }
+
+    float scale = height / FONT_UNITS_HIGH;
+    StrokePoint simd[MAX_GLYPH_POINTS], scalar[MAX_GLYPH_POINTS];
+    long mismatches = 0;
+    const float ys[] = {0, -height, -1000 * height, -123456.78f};
+    for (int k = 0; k < (int)(sizeof(ys) / sizeof(ys[0])); k++) {
+        for (int g = 0; g < num_glyphs; g++) {
+            float x = 0.37f * g * height;
+            TransformPoints(glyphs[g]->point_x, glyphs[g]->point_y, glyphs[g]->num_points, x, ys[k], scale, shear,
+                            simd);
+            TransformPointsScalar(glyphs[g]->point_x, glyphs[g]->point_y, glyphs[g]->num_points, x, ys[k], scale,
+                                  shear, scalar);
+            mismatches += memcmp(simd, scalar, glyphs[g]->num_points * sizeof(StrokePoint)) != 0;
+        }
+    }
+
+    double simd_seconds = TimeTransform(TransformPoints, glyphs, num_glyphs, scale, shear, simd);
+    double scalar_seconds = TimeTransform(TransformPointsScalar, glyphs, num_glyphs, scale, shear, scalar);
+    printf("Transform: %d characters, %ld points each way\n", num_glyphs, BENCHMARK_POINTS);
+    printf("  %s %.3f s (%.0f Mpoints/s), scalar %.3f s (%.0f Mpoints/s), %.2fx\n", TransformKernel(), simd_seconds,
+           BENCHMARK_POINTS / simd_seconds / 1e6, scalar_seconds, BENCHMARK_POINTS / scalar_seconds / 1e6,
+           scalar_seconds / simd_seconds);
+    if (mismatches > 0) {
+        printf("  %ld characters came out differently, the versions do not match\n", mismatches);
+        return -1;
+    }
+    printf("  both versions put every point in the same place\n");
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef TRANSFORM_H_INCLUDED
+#define TRANSFORM_H_INCLUDED
+
+#include "font.h"
+#include "stroke.h"
+
+#define BENCHMARK_POINTS 200000000L // Points each version moves in BenchmarkTransform()
+
+//Moves points from font units onto the page, count at a time, from separate x and y arrays into StrokePoints:
+//    x = x_offset + px * scale + py * shear,  y = y_offset + py * scale
+//shear slants the text (italics), 0 leaves it upright. Both versions give exactly the same floats.
+void TransformPoints(const float *px, const float *py, int count, float x_offset, float y_offset, float scale,
+                     float shear, StrokePoint *out);        // With SIMD where the build has it
+void TransformPointsScalar(const float *px, const float *py, int count, float x_offset, float y_offset, float scale,
+                           float shear, StrokePoint *out);  // One point at a time
+const char *TransformKernel(void);                          // Which SIMD TransformPoints() uses: "AVX", "SSE2" or "none"
+int BenchmarkTransform(const Font *font, float height, float shear); // Time both versions, -1 if they differ
+
+#endif // TRANSFORM_H_INCLUDED
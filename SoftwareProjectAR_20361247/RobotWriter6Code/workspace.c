@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <float.h>
+
+#include "workspace.h"
+
+void EmptyBox(Box *box) {
+    box->min_x = box->min_y = FLT_MAX;
+    box->max_x = box->max_y = -FLT_MAX;
+}
+
+//An empty box is inside any workspace
+int BoxInside(const Box *box, const Box *workspace) {
+    if (box->min_x > box->max_x) {
+        return 1;
+    }
+    return box->min_x >= workspace->min_x && box->max_x <= workspace->max_x &&
+           box->min_y >= workspace->min_y && box->max_y <= workspace->max_y;
+}
+
+// Cuts the move from a to b down to the part inside the workspace, as how far along the move it starts and ends
+// (Liang-Barsky). Returns 0 if none of it is inside.
+static int ClipMove(const Box *workspace, const StrokePoint *a, const StrokePoint *b, float *start, float *end) {
+    float dx = b->x - a->x, dy = b->y - a->y;
+    float along[4] = {-dx, dx, -dy, dy};
+    float room[4] = {a->x - workspace->min_x, workspace->max_x - a->x, a->y - workspace->min_y, workspace->max_y - a->y};
+    *start = 0;
+    *end = 1;
+    for (int edge = 0; edge < 4; edge++) {
+        if (along[edge] == 0) {
+            if (room[edge] < 0) {
+                return 0; // Runs alongside this edge, on the outside of it
+            }
+            continue;
+        }
+        float t = room[edge] / along[edge];
+        if (along[edge] < 0) {
+            if (t > *end) {
+                return 0;
+            }
+            *start = t > *start ? t : *start; // Comes in over this edge
+        }
+        else {
+            if (t < *start) {
+                return 0;
+            }
+            *end = t < *end ? t : *end;       // Goes out over this edge
+        }
+    }
+    return 1;
+}
+
+//Cuts every stroke off where it leaves the workspace. A stroke that goes out and comes back in carries on as a new
+//stroke, so the pen is lifted over the part the robot cannot reach. The clipped strokes are built in scratch and
+//the two lists swap memory. Returns how many strokes were cut, -1 if it ran out of memory, when nothing is kept.
+long ClipStrokes(StrokeList *list, const Box *workspace, StrokeList *scratch) {
+    Box box;
+    EmptyBox(&box);
+    StrokeBounds(list, &box);
+    if (BoxInside(&box, workspace)) {
+        return 0; // Nearly always: nothing to cut and the points stay exactly as they were
+    }
+
+    ClearStrokes(scratch);
+    long cut = 0;
+    int failed = 0;
+    for (int s = 0; s < list->num_strokes && !failed; s++) {
+        const StrokePoint *points = &list->points[list->strokes[s].first];
+        int count = list->strokes[s].count;
+        if (count == 1) {
+            Box dot = {points[0].x, points[0].y, points[0].x, points[0].y};
+            if (BoxInside(&dot, workspace)) {
+                failed = BeginStroke(scratch, points[0].x, points[0].y) != 0;
+            }
+            else {
+                cut++;
+            }
+            continue;
+        }
+
+        int open = 0, whole = 1;
+        for (int i = 1; i < count && !failed; i++) {
+            const StrokePoint *a = &points[i - 1], *b = &points[i];
+            float start, end;
+            if (!ClipMove(workspace, a, b, &start, &end)) {
+                open = 0;
+                whole = 0;
+                continue;
+            }
+            if (!open || start > 0) {
+                failed = BeginStroke(scratch, a->x + (b->x - a->x) * start, a->y + (b->y - a->y) * start) != 0;
+                open = 1;
+            }
+            if (end < 1) {
+                failed |= AddStrokePoint(scratch, a->x + (b->x - a->x) * end, a->y + (b->y - a->y) * end) != 0;
+                open = 0;
+            }
+            else {
+                failed |= AddStrokePoint(scratch, b->x, b->y) != 0;
+            }
+            whole &= start == 0 && end == 1;
+        }
+        cut += !whole;
+    }
+
+    StrokeList swap = *list;
+    *list = *scratch;
+    *scratch = swap;
+    if (failed) {
+        ClearStrokes(list); // Better to leave the batch out than send anything out of reach
+        return -1;
+    }
+    return cut;
+}
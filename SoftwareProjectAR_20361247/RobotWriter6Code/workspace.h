@@ -0,0 +1,11 @@
+#ifndef WORKSPACE_H_INCLUDED
+#define WORKSPACE_H_INCLUDED
+
+#include "stroke.h"
+
+//Keeping the pen within what the robot can reach
+void EmptyBox(Box *box);                                        // A box with nothing in it, for StrokeBounds()
+int BoxInside(const Box *box, const Box *workspace);            // Whether all of box is in the workspace
+long ClipStrokes(StrokeList *list, const Box *workspace, StrokeList *scratch); // Cut off what is outside, returns the strokes cut
+
+#endif // WORKSPACE_H_INCLUDED